@@ -16,7 +16,8 @@ class ManualWakeUpState {
  public:
   STATE_CLASS("Awakening")
 
-  SequencerState seq = SequencerState(&front_servos, &back_servos, &front_state_publisher, &back_state_publisher);
+  SequencerState seq = SequencerState(&front_servos, &back_servos, &front_state_publisher, &back_state_publisher,
+                                        &body_state_publisher);
 };
 
 } // namespace smov
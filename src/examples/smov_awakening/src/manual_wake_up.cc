@@ -16,8 +16,7 @@ void ManualWakeUpState::on_start() {
     back_servos.value[i + 2 * (SERVO_MAX_SIZE / 3)] = 0.6f;
   }
 
-  front_state_publisher->publish(front_servos);
-  back_state_publisher->publish(back_servos);
+  publish_body();
 
   std::vector<float> b_vals;
   for (float i = 0.8; i > 0.02; i -= 0.02) {
@@ -19,7 +19,8 @@ class BreathState {
 
   std::array<std::array<float, 2>, 12> data = {{{0, 120},{0, 120},{55, 145},{55, 145},{70, 150},{70, 150},  // Front servos.
                                                {0, 120},{0, 120},{55, 145},{55, 145},{70, 150},{70, 150}}}; // Back servos.               
-  TrigonometryState trig = TrigonometryState(&front_servos, &back_servos, &front_state_publisher, &back_state_publisher, 14, 14, 2.5f, data);
+  TrigonometryState trig = TrigonometryState(&front_servos, &back_servos, &front_state_publisher, &back_state_publisher, 14, 14, 2.5f, data,
+                                             &body_state_publisher);
 };
 
 } // namespace smov
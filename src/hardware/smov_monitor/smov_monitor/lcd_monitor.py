@@ -1,5 +1,6 @@
 import rclpy
 from rclpy.node import Node
+from rclpy.qos import DurabilityPolicy, QoSProfile
 from monitor_msgs.msg import DisplayText
 from time import *
 import smbus
@@ -147,7 +148,7 @@ class MonitorNode(Node):
             DisplayText,
             'data_display',
             self.listener_callback,
-            10)
+            QoSProfile(depth=1, durability=DurabilityPolicy.TRANSIENT_LOCAL))
         self.subscription  
         lcd.lcd_display_string("What's up world?", 1)
 
@@ -0,0 +1,52 @@
+from launch import LaunchDescription
+from launch_ros.actions import ComposableNodeContainer
+from launch_ros.descriptions import ComposableNode
+
+
+def generate_launch_description():
+    # Both board controllers and the states manager share one process, so the frames go from the manager to the
+    # boards through intra-process communication, without being serialized. The multi-threaded container lets the
+    # front and back halves of the manager be forwarded concurrently.
+    intra_process = [{'use_intra_process_comms': True}]
+
+    # Each controller drives the single board of its bus, and no other controller shares it, so stopping the servos is
+    # one ALLCALL broadcast per board.
+    board_parameters = {
+        'i2c_bus_boards': 1,
+        'i2c_bus_exclusive': True,
+        'pwm_atomic_frames': True,
+    }
+
+    return LaunchDescription([
+        ComposableNodeContainer(
+            name='smov_container',
+            namespace='',
+            package='rclcpp_components',
+            executable='component_container_mt',
+            composable_node_descriptions=[
+                # The boards are loaded first, the states manager calibrates them as soon as their services are up.
+                ComposableNode(
+                    package='smov_board',
+                    plugin='smov::BoardComponent',
+                    name='front_board',
+                    parameters=[dict(board_parameters, board_number=1)],
+                    extra_arguments=intra_process
+                ),
+                ComposableNode(
+                    package='smov_board',
+                    plugin='smov::BoardComponent',
+                    name='back_board',
+                    parameters=[dict(board_parameters, board_number=2)],
+                    extra_arguments=intra_process
+                ),
+                ComposableNode(
+                    package='smov_states',
+                    plugin='smov::RobotNodeHandle',
+                    name='smov_states',
+                    parameters=["config/config.yaml"],
+                    extra_arguments=intra_process
+                ),
+            ],
+            output='screen',
+        )
+    ])
@@ -14,8 +14,7 @@ void SequencerState::execute_muscles_sequence(RobotMuscles group, const std::vec
           back_servos->value[j] = i;
         }
         RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Sending value: %f", i);
-        (*front_state_publisher)->publish(*front_servos);
-        (*back_state_publisher)->publish(*back_servos);
+        publish_body();
         delay(cool_down);
       }
       break;
@@ -26,8 +25,7 @@ void SequencerState::execute_muscles_sequence(RobotMuscles group, const std::vec
           back_servos->value[j + (SERVO_MAX_SIZE / 3)] = i;
         }
         RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Sending value: %f", i);
-        (*front_state_publisher)->publish(*front_servos);
-        (*back_state_publisher)->publish(*back_servos);
+        publish_body();
         delay(cool_down);
       }
       break;
@@ -38,8 +36,7 @@ void SequencerState::execute_muscles_sequence(RobotMuscles group, const std::vec
           back_servos->value[j + 2 * (SERVO_MAX_SIZE / 3)] = i;
         }
         RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Sending value: %f", i);
-        (*front_state_publisher)->publish(*front_servos);
-        (*back_state_publisher)->publish(*back_servos);
+        publish_body();
         delay(cool_down);
       }
       break;
@@ -22,13 +22,14 @@ class TrigonometryState {
   TrigonometryState(smov_states_msgs::msg::StatesServos *f_servos, smov_states_msgs::msg::StatesServos *b_servos,
                     rclcpp::Publisher<smov_states_msgs::msg::StatesServos>::SharedPtr *f_pub,
                     rclcpp::Publisher<smov_states_msgs::msg::StatesServos>::SharedPtr *b_pub,
-                    float _l1, float _l2, float _leg_width, std::array<std::array<float, 2>, 12> _data)
+                    float _l1, float _l2, float _leg_width, std::array<std::array<float, 2>, 12> _data,
+                    rclcpp::Publisher<smov_states_msgs::msg::BodyServos>::SharedPtr *body_pub = nullptr)
       : front_servos(f_servos), back_servos(b_servos),
-        front_state_publisher(f_pub), back_state_publisher(b_pub),
+        front_state_publisher(f_pub), back_state_publisher(b_pub), body_state_publisher(body_pub),
         l1(_l1), l2(_l2), leg_width(_leg_width), data(_data) {}
 
   static float convert_rad_to_deg(float rad);
-  void move_servo_to_ang(MicroController mc, int servo, float angle);
+  void move_servo_to_ang(MicroController mc, int servo, float angle, bool publish = true);
   Vector3 set_leg_to(Vector3 xyz);
   void set_legs_distance_to(float value);
 
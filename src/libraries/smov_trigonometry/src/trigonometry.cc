@@ -6,7 +6,7 @@ float TrigonometryState::convert_rad_to_deg(float rad) {
   return static_cast<float>((rad * (180.0f / M_PI)));
 }
 
-void TrigonometryState::move_servo_to_ang(MicroController mc, int servo, float angle) {
+void TrigonometryState::move_servo_to_ang(MicroController mc, int servo, float angle, bool publish) {
   float relative_servo = servo;
   if (mc == BACK) relative_servo += SERVO_MAX_SIZE;
 
@@ -21,11 +21,11 @@ void TrigonometryState::move_servo_to_ang(MicroController mc, int servo, float a
   if (mc == FRONT) {
     front_servos->value[servo] = result;
     RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Final result=%f", result);
-    (*front_state_publisher)->publish(*front_servos);
+    if (publish) (*front_state_publisher)->publish(*front_servos);
   } else {
     back_servos->value[servo] = result;
     RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Final result=%f", result);
-    (*back_state_publisher)->publish(*back_servos);
+    if (publish) (*back_state_publisher)->publish(*back_servos);
   }
 }
 
@@ -56,20 +56,23 @@ void TrigonometryState::set_legs_distance_to(float value) {
   RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Theta angle is=%f", theta);
 
   // Moving the front biceps servos.
-  move_servo_to_ang(FRONT, 2, convert_rad_to_deg(b));
-  move_servo_to_ang(FRONT, 3, convert_rad_to_deg(b));
+  move_servo_to_ang(FRONT, 2, convert_rad_to_deg(b), false);
+  move_servo_to_ang(FRONT, 3, convert_rad_to_deg(b), false);
 
   // Moving the front legs servos.
-  move_servo_to_ang(FRONT, 4, convert_rad_to_deg(theta));
-  move_servo_to_ang(FRONT, 5, convert_rad_to_deg(theta));
+  move_servo_to_ang(FRONT, 4, convert_rad_to_deg(theta), false);
+  move_servo_to_ang(FRONT, 5, convert_rad_to_deg(theta), false);
 
   // Moving the back biceps servos.
-  move_servo_to_ang(BACK, 2, convert_rad_to_deg(b));
-  move_servo_to_ang(BACK, 3, convert_rad_to_deg(b));
+  move_servo_to_ang(BACK, 2, convert_rad_to_deg(b), false);
+  move_servo_to_ang(BACK, 3, convert_rad_to_deg(b), false);
 
   // Moving the back legs servos.
-  move_servo_to_ang(BACK, 4, convert_rad_to_deg(theta));
-  move_servo_to_ang(BACK, 5, convert_rad_to_deg(theta));
+  move_servo_to_ang(BACK, 4, convert_rad_to_deg(theta), false);
+  move_servo_to_ang(BACK, 5, convert_rad_to_deg(theta), false);
+
+  // The whole pose is sent at once.
+  publish_body();
 }
 
 }
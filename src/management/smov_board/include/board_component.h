@@ -0,0 +1,29 @@
+//
+// Created by ros on 2/3/24.
+//
+
+#ifndef BOARD_COMPONENT_H_
+#define BOARD_COMPONENT_H_
+
+#include <rclcpp/rclcpp.hpp>
+
+#include "board_handler.h"
+
+namespace smov {
+
+// The board controller as a composable node, so the states manager and the boards can share a process and pass
+// frames through intra-process communication.
+class BoardComponent {
+ public:
+  explicit BoardComponent(const rclcpp::NodeOptions &options);
+  ~BoardComponent();
+
+  rclcpp::node_interfaces::NodeBaseInterface::SharedPtr get_node_base_interface() const;
+
+ private:
+  std::shared_ptr<smov::BoardHandler> board_handler;
+};
+
+}
+
+#endif // BOARD_COMPONENT_H_
@@ -5,9 +5,24 @@
 #ifndef BOARD_CONTROLLER_H_
 #define BOARD_CONTROLLER_H_
 
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include <rclcpp/rclcpp.hpp>
 
-#define BASE_ADDR   0x40
+#include "board_metrics.h"
+#include "drive_mixer.h"
+#include "frame_mailbox.h"
+#include "i2c_transport.h"
+#include "pca9685.h"
+#include "servo_table.h"
+
+#define PWM_STAGGER_STEP 256   // ON tick offset between consecutive channels, 16 channels cover the 4096 ticks.
 #define CONST(s) ((char*)(s))
 #define MAX_BOARDS 62
 #define MAX_SERVOS (16*MAX_BOARDS)
@@ -15,12 +30,12 @@
 
 namespace smov {
 
-typedef struct _servo_config {
+typedef struct _servo_calibration {
+  int servo;
   int center;
   int range;
   int direction;
-  int mode_pos;
-} ServoConfig;
+} ServoCalibration;
 
 typedef struct _drive_mode {
   int mode;
@@ -47,63 +62,133 @@ enum drive_mode_positions {
   POSITION_INVALID = 5
 };
 
-enum pwm_regs {
-  // Registers / etc.
-  MODE1 = 0x00,
-  MODE2 = 0x01,
-  SUBADR1 = 0x02,              // Enable sub address 1 support.
-  SUBADR2 = 0x03,              // Enable sub address 2 support.
-  SUBADR3 = 0x04,              // Enable sub address 2 support.
-  PRESCALE = 0xFE,
-  CHANNEL_ON_L = 0x06,
-  CHANNEL_ON_H = 0x07,
-  CHANNEL_OFF_L = 0x08,
-  CHANNEL_OFF_H = 0x09,
-  ALL_CHANNELS_ON_L = 0xFA,
-  ALL_CHANNELS_ON_H = 0xFB,
-  ALL_CHANNELS_OFF_L = 0xFC,
-  ALL_CHANNELS_OFF_H = 0xFD,
-  RESTART = 0x80,
-  SLEEP = 0x10,              // Enable low power mode.
-  ALLCALL = 0x01,
-  INVRT = 0x10,              // Invert the output control logic.
-  OUTDRV = 0x04
+// One I2C bus and the boards on it. Each bus has its own writer thread, so the buses of a controller are written in
+// parallel.
+struct BoardBus {
+  std::unique_ptr<smov::I2cTransport> transport; // Linux i2c-dev or simulated.
+  uint64_t boards = 0;         // The boards on this bus, bit 0 being board 1.
+
+  // The boards of this bus with work not done yet (guarded by wake_mutex).
+  uint64_t pending_boards = 0;
+  uint64_t pending_setup = 0;  // Boards to bring up or whose prescaler must follow pwm_frequency.
+
+  // Everything touching the bus holds this lock, it is recursive as board bring-up goes through the public setters.
+  std::recursive_mutex bus_mutex;
+  std::mutex wake_mutex;
+  std::condition_variable wake_condition;
+  std::thread writer;
+  bool writer_running = false; // Guarded by wake_mutex.
+  int verify_board_index = -1; // Last board verified, owned by the writer thread.
 };
 
 // The class that handles messages between the controller and ROS2.
 class BoardNode : public rclcpp::Node {
  public:
-  explicit BoardNode(const std::string &node_name = "smov_board", const std::string &node_namespace = "/");
+  explicit BoardNode(const std::string &node_name = "smov_board",
+                     const std::string &node_namespace = "/",
+                     const rclcpp::NodeOptions &options = rclcpp::NodeOptions());
+  ~BoardNode() override;
   float convert_mps_to_proportional(float speed);
   void set_pwm_frequency(int freq);
   void set_pwm_interval_all(int start, int end);
+  uint64_t set_pwm_interval_broadcast(int start, int end);
   void set_active_board(int board);
   void set_pwm_interval(int servo, int start, int end);
   void set_pwm_interval_proportional(int servo, float value);
+  void stage_pwm_interval(int servo, int start, int end);
+  bool stage_pwm_interval_proportional(int servo, float value);
+  int stage_pwm_intervals_proportional(const int *servos, const float *values, int count);
+  void write_pwm_frame();
+  void discard_pwm_frames();
+  void start_writer(int priority, int cpu);
+  void stop_writer();
   void config_servo(int servo, int center, int range, int direction);
+  int config_servos(const std::vector<smov::ServoCalibration> &calibrations);
   int config_servo_position(int servo, int position);
   int config_drive_mode(const std::string &mode, float rpm, float radius, float track, float scale);
   int init(int io_device, int frequency);
 
   int get_active_board() const;
+  int get_pwm_frequency() const;
   int get_last_servo() const;
+  const smov::I2cTransport *get_transport(int board) const;
   smov::DriveMode get_active_drive() const;
 
   // We can support up to 62 boards (1..62), each with 16 PWM devices (1..16)
   // Made public to keep array usage and not convert to std for now
-  smov::ServoConfig servo_configs[MAX_SERVOS]{};
+  // A board is -1 until it is brought up by the writer of its bus, then 1, and is read from the executor.
   smov::DriveMode active_drive{};
-  int pwm_boards[MAX_BOARDS] = {};
+  std::atomic<int> pwm_boards[MAX_BOARDS]{};
+
+  // Drive servos indexed by wheel position, kept in sync with the drive mode and the servo positions.
+  smov::DriveMixer drive_mixer;
+
+  // Bus and latency statistics, recorded lock-free by the executor and the writer thread.
+  smov::BoardMetrics metrics;
 
  private:
-  void setup(const char *filename);
+  void setup(std::vector<std::unique_ptr<smov::I2cTransport>> transports, int boards_per_bus);
+  smov::BoardBus &get_bus(int board);
+  void init_board(int board);
+  void request_setup(uint64_t boards);
+  int get_prescale() const;
+  void program_prescaler(int board);
+  void write_all_channels(int board, int start, int end);
+  int get_board_address(int board) const;
+  int write_register(int board, uint8_t reg, uint8_t value);
+  int read_register(int board, uint8_t reg);
+  bool is_valid_calibration(const smov::ServoCalibration &calibration) const;
+  void convert_proportional(const smov::ServoTable &table,
+                            const int *index,
+                            const float *values,
+                            uint16_t *counts,
+                            int count) const;
+  void writer_loop(smov::BoardBus *bus);
+  void verify_next_board(smov::BoardBus &bus);
+  void verify_board(int board);
+  void write_pending_frames(smov::BoardBus &bus);
+  bool is_uniform_frame(uint64_t boards, uint16_t &start, uint16_t &end) const;
+  void write_board_frame(int board, const smov::PwmFrame &frame);
+  bool write_channels(int board, int channel, int count, const uint16_t *on, const uint16_t *off);
 
   int active_board; // Default is 0
   int last_servo; // defaults to -1
-  int pwm_frequency;                    // Default is 50Hz.
-  int controller_io_handle; // Defaults to 0
+  std::atomic<int> pwm_frequency;       // Default is 50Hz.
   int controller_io_device; // Defaults to 0
+  bool stagger_pulses;      // Spread the ON tick of the channels of a board, defaults to false.
+  bool atomic_frames;       // Write each board frame as one transaction committed on STOP, defaults to true.
+  bool exclusive_buses;     // Only this controller drives PCA9685 boards on its buses, defaults to true.
+
+  // The buses the boards are on. Boards are numbered across the buses: the first bus holds boards 1..bus_boards at
+  // addresses 0x40 and up, the next one the following boards from 0x40 again, and so on.
+  std::vector<std::unique_ptr<smov::BoardBus>> buses;
+  int bus_boards;   // Boards per bus.
+  int board_count;  // Boards reachable on all the buses, at most 62.
+
+  // The requested state, owned by the executor: ON/OFF counts per servo, a mask of the requested channels on each
+  // board, and the boards staged since the last frame was published.
+  uint16_t frame_on[MAX_SERVOS]{};
+  uint16_t frame_off[MAX_SERVOS]{};
+  uint16_t frame_mask[MAX_BOARDS]{};
+  int64_t frame_stamp[MAX_BOARDS]{}; // When the first value of the pending frame was staged, in steady clock ns.
+  uint64_t staged_boards;
+
+  // Latest published frame of each board, taken by the writer of its bus.
+  smov::FrameMailbox mailboxes[MAX_BOARDS];
+  int verify_period_ms; // Period between two board read-backs on each bus, 0 disables them.
+
+  // Configuration and precomputed proportional conversion of the configured servos. A table is never modified once
+  // published: a new calibration swaps in a new table, read and replaced with std::atomic_load/std::atomic_store.
+  std::shared_ptr<const smov::ServoTable> servo_table;
+
+  // Prescaler value each board runs with, -1 when unknown. Owned by the bus of the board.
+  int board_prescale[MAX_BOARDS]{};
 
+  // Shadow copy of what the ON/OFF registers hold, and a mask of the channels whose shadow is known per board. Owned
+  // by the bus of the board.
+  uint16_t shadow_on[MAX_SERVOS]{};
+  uint16_t shadow_off[MAX_SERVOS]{};
+  uint16_t shadow_mask[MAX_BOARDS]{};
 };
 }
 #endif //BOARD_CONTROLLER_H_
@@ -5,12 +5,17 @@
 #ifndef BOARD_HANDLER_H_
 #define BOARD_HANDLER_H_
 
+#include <chrono>
+#include <vector>
+
 #include <rclcpp/rclcpp.hpp>
 #include <rclcpp/logging.hpp>
 #include <std_srvs/srv/empty.hpp>
 #include <geometry_msgs/msg/twist.hpp>
+#include <diagnostic_msgs/msg/diagnostic_array.hpp>
 
 #include "smov_board_msgs/msg/servo_array.hpp"
+#include "smov_board_msgs/msg/servo_frame.hpp"
 #include "smov_board_msgs/srv/servos_config.hpp"
 #include "smov_board_msgs/srv/drive_mode.hpp"
 #include "smov_board_msgs/srv/int_value.hpp"
@@ -22,13 +27,15 @@ namespace smov {
 class BoardHandler {
 
  public:
-  explicit BoardHandler(const std::string &node_name);
+  explicit BoardHandler(const std::string &node_name, const rclcpp::NodeOptions &options = rclcpp::NodeOptions());
   void init(int io_device, int frequency);
   void set_handlers(int board_number);
 
-  void servos_absolute_handler(std::shared_ptr<smov_board_msgs::msg::ServoArray> msg);
-  void servos_proportional_handler(std::shared_ptr<smov_board_msgs::msg::ServoArray> msg);
+  void servos_absolute_handler(smov_board_msgs::msg::ServoArray::UniquePtr msg);
+  void servos_proportional_handler(smov_board_msgs::msg::ServoArray::UniquePtr msg);
+  void servos_frame_handler(smov_board_msgs::msg::ServoFrame::UniquePtr msg);
   void servos_drive_handler(std::shared_ptr<geometry_msgs::msg::Twist> msg);
+  void drive_tick_handler();
   bool set_pwm_frequency_handler(std::shared_ptr<smov_board_msgs::srv::IntValue::Request> req,
                                  std::shared_ptr<smov_board_msgs::srv::IntValue::Response> res);
   bool config_servos_handler(std::shared_ptr<smov_board_msgs::srv::ServosConfig::Request> req,
@@ -37,6 +44,8 @@ class BoardHandler {
                                  std::shared_ptr<smov_board_msgs::srv::DriveMode::Response> res);
   bool stop_servos_handler(std::shared_ptr<std_srvs::srv::Empty::Request> req,
                            std::shared_ptr<std_srvs::srv::Empty::Response> res);
+  void publish_diagnostics();
+  void dump_metrics() const;
 
   std::shared_ptr<smov::BoardNode> board_node;
 
@@ -45,10 +54,31 @@ class BoardHandler {
   rclcpp::Service<smov_board_msgs::srv::ServosConfig>::SharedPtr config_srv;
   rclcpp::Subscription<smov_board_msgs::msg::ServoArray>::SharedPtr abs_sub;
   rclcpp::Subscription<smov_board_msgs::msg::ServoArray>::SharedPtr rel_sub;
+  rclcpp::Subscription<smov_board_msgs::msg::ServoFrame>::SharedPtr frame_sub;
   rclcpp::Service<smov_board_msgs::srv::IntValue>::SharedPtr freq_srv;
   rclcpp::Service<smov_board_msgs::srv::DriveMode>::SharedPtr mode_srv;
   rclcpp::Service<std_srvs::srv::Empty>::SharedPtr stop_srv;
   rclcpp::Subscription<geometry_msgs::msg::Twist>::SharedPtr drive_sub;
+  rclcpp::TimerBase::SharedPtr drive_timer;
+  rclcpp::Publisher<diagnostic_msgs::msg::DiagnosticArray>::SharedPtr diagnostics_pub;
+  rclcpp::TimerBase::SharedPtr diagnostics_timer;
+
+  // Scratch arrays handing a ServoArray over to the batch conversion.
+  std::vector<int> batch_servos;
+  std::vector<float> batch_values;
+
+  uint32_t last_frame_sequence = 0; // Sequence of the last ServoFrame taken, frames older than it are stale.
+
+  void start_drive_timer();
+
+  // Drive commands as (linear.x, linear.y, angular.z): the latest Twist is the target, the speeds written move
+  // towards it once per PWM period, within the acceleration limits (0 for no limit).
+  float drive_target[3]{};
+  float drive_current[3]{};
+  bool drive_pending = false;
+  double drive_linear_accel = 0.0;  // In meters per second squared.
+  double drive_angular_accel = 0.0; // In radians per second squared.
+  std::chrono::steady_clock::time_point drive_tick;
 
 };
 }
@@ -0,0 +1,70 @@
+//
+// Created by ros on 2/3/24.
+//
+
+#ifndef BOARD_METRICS_H_
+#define BOARD_METRICS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define METRICS_MAX_BOARDS 62
+#define METRICS_MAX_SERVOS (16*METRICS_MAX_BOARDS)
+
+namespace smov {
+
+// Lock-free histogram with power of two buckets, safe to record from any thread.
+// Bucket 0 counts zeroes, bucket n counts values in [2^(n-1), 2^n).
+class Histogram {
+ public:
+  static constexpr int BUCKETS = 40;
+
+  Histogram();
+  void record(uint64_t value);
+
+  uint64_t get_count() const;
+  uint64_t get_max() const;
+  double get_mean() const;
+  uint64_t get_percentile(double percentile) const;
+  std::string to_string() const;
+
+ private:
+  std::atomic<uint64_t> buckets[BUCKETS];
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> sum;
+  std::atomic<uint64_t> max;
+};
+
+// Timing and traffic statistics of a board controller.
+class BoardMetrics {
+ public:
+  BoardMetrics();
+
+  void record_board_error(int board);
+  void record_channel_errors(int board, int channel, int count);
+
+  // Key/value pairs describing the metrics, for diagnostics and logs.
+  std::vector<std::pair<std::string, std::string>> get_values() const;
+
+  Histogram frame_latency_us;   // From the frame arrival to its last register write.
+  Histogram callback_time_us;   // Time spent in the topic callbacks.
+  Histogram frame_bytes;        // Bytes on the bus per board frame.
+  Histogram frame_transactions; // Bus transactions per board frame.
+
+  std::atomic<uint64_t> writes_issued;  // Channels actually sent on the bus.
+  std::atomic<uint64_t> writes_skipped; // Channels dropped because the board already held the value.
+  std::atomic<uint64_t> frames_replaced; // Frames replaced by a newer one before reaching the bus.
+  std::atomic<uint64_t> frames_stale;    // Frames received out of order or twice, and dropped.
+  std::atomic<uint64_t> boards_verified; // Boards whose registers were read back.
+  std::atomic<uint64_t> boards_reset;    // Boards found in their reset state and brought up again.
+  std::atomic<uint64_t> channels_repaired; // Channels found different from what was written, and rewritten.
+
+  std::atomic<uint64_t> board_errors[METRICS_MAX_BOARDS];
+  std::atomic<uint64_t> channel_errors[METRICS_MAX_SERVOS];
+};
+
+}
+
+#endif // BOARD_METRICS_H_
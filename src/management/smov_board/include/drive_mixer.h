@@ -0,0 +1,56 @@
+//
+// Created by ros on 2/3/24.
+//
+
+#ifndef DRIVE_MIXER_H_
+#define DRIVE_MIXER_H_
+
+#include <vector>
+
+namespace smov {
+
+// Turns Twist velocities into proportional speeds for every drive servo.
+// The drive servos are indexed by wheel position when they or the drive mode are configured, so mixing a Twist
+// does not look at the servos that do not drive. The speed of a wheel position is a row of the mixing matrix
+// applied to (linear.x, linear.y, angular.z), every servo at that position then takes it.
+class DriveMixer {
+ public:
+  static constexpr int WHEELS = 4; // Left front, right front, left rear and right rear.
+
+  DriveMixer();
+
+  // The drive settings must have been validated, the position is one of drive_mode_positions.
+  void configure(int mode, float rpm, float radius, float track, float scale);
+  void set_position(int servo, int position);
+  void clear();
+
+  // Mixes a Twist, the result is valid until the next call.
+  int mix(float linear_x, float linear_y, float angular_z);
+  const int *get_servos() const;
+  const float *get_values() const;
+  const float *get_wheel_speeds() const;
+
+ private:
+  void update_index();
+
+  int mode;
+  float half_track;
+  float scale;
+  float max_rate; // The speed of a wheel at full throttle, in meters per second.
+
+  // Mixing matrix, one row per wheel position, zero for the positions the mode does not drive.
+  float mix_x[WHEELS]{};
+  float mix_y[WHEELS]{};
+  float mix_r[WHEELS]{};
+  float wheel_speeds[WHEELS]{};
+
+  // Servos configured at each wheel position, and the ones the mode drives with the wheel they follow.
+  std::vector<int> position_servos[WHEELS];
+  std::vector<int> servos;
+  std::vector<int> wheels;
+  std::vector<float> values;
+};
+
+} // namespace smov
+
+#endif // DRIVE_MIXER_H_
@@ -0,0 +1,47 @@
+//
+// Created by ros on 2/3/24.
+//
+
+#ifndef FRAME_MAILBOX_H_
+#define FRAME_MAILBOX_H_
+
+#include <atomic>
+#include <cstdint>
+
+namespace smov {
+
+// The requested state of the 16 channels of a board.
+typedef struct _pwm_frame {
+  uint16_t on[16];
+  uint16_t off[16];
+  uint16_t mask;  // Channels holding a requested value.
+  int64_t stamp;  // When the frame was requested, in steady clock ns.
+} PwmFrame;
+
+// Lock-free single-slot mailbox holding the latest frame of a board.
+// One thread publishes frames and one thread takes them, a frame published
+// before the previous one was taken replaces it instead of being queued.
+class FrameMailbox {
+ public:
+  FrameMailbox();
+
+  // Producer side: fill the back frame, then publish it.
+  PwmFrame &get_back();
+  bool publish();
+
+  // Consumer side: returns the latest published frame, or nullptr if nothing new was published.
+  const PwmFrame *take();
+
+ private:
+  static constexpr uint8_t FRESH = 0x04;
+  static constexpr uint8_t INDEX = 0x03;
+
+  PwmFrame frames[3]{};
+  uint8_t back;                // Owned by the producer.
+  uint8_t front;               // Owned by the consumer.
+  std::atomic<uint8_t> middle; // Exchanged between both, with the FRESH flag.
+};
+
+}
+
+#endif // FRAME_MAILBOX_H_
@@ -0,0 +1,89 @@
+//
+// Created by ros on 2/3/24.
+//
+
+#ifndef I2C_TRANSPORT_H_
+#define I2C_TRANSPORT_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace smov {
+
+// How the board controller reaches the PCA9685 registers.
+// Every call is one bus transaction addressing a register of the device at the 7 bit address.
+class I2cTransport {
+ public:
+  virtual ~I2cTransport() = default;
+
+  virtual bool open_bus() = 0;
+  virtual bool write(int address, uint8_t reg, const uint8_t *data, size_t length) = 0;
+  virtual bool read(int address, uint8_t reg, uint8_t *data, size_t length) = 0;
+  virtual std::string get_name() const = 0;
+};
+
+// The Linux i2c-dev transport, on /dev/i2c-N.
+class LinuxI2cTransport : public I2cTransport {
+ public:
+  explicit LinuxI2cTransport(const std::string &device);
+  ~LinuxI2cTransport() override;
+
+  bool open_bus() override;
+  bool write(int address, uint8_t reg, const uint8_t *data, size_t length) override;
+  bool read(int address, uint8_t reg, uint8_t *data, size_t length) override;
+  std::string get_name() const override;
+
+ private:
+  int get_handle(int address);
+
+  std::string device;
+  int bus_handle;          // Defaults to -1
+  bool use_block_transfer; // True when the adapter supports plain I2C_RDWR transfers.
+
+  // One handle per address, bound once with I2C_SLAVE so the hot path never re-selects the slave.
+  std::map<int, int> handles;
+};
+
+// An in-memory bus of PCA9685 register files, for running the controller without hardware.
+// Every transaction is accounted with the time it would take on a real bus at the given clock. It does not depend on
+// ROS, the controller logs its statistics.
+class SimulatedI2cTransport : public I2cTransport {
+ public:
+  explicit SimulatedI2cTransport(int bus_speed, bool realtime = false);
+  ~SimulatedI2cTransport() override;
+
+  bool open_bus() override;
+  bool write(int address, uint8_t reg, const uint8_t *data, size_t length) override;
+  bool read(int address, uint8_t reg, uint8_t *data, size_t length) override;
+  std::string get_name() const override;
+
+  int get_bus_speed() const;
+  uint64_t get_transactions() const;
+  uint64_t get_bytes() const;
+  uint64_t get_bus_time_ns() const;
+
+ private:
+  typedef struct _register_file {
+    uint8_t regs[256];
+  } RegisterFile;
+
+  RegisterFile &get_device(int address);
+  void write_device(RegisterFile &device, uint8_t reg, const uint8_t *data, size_t length);
+  uint8_t next_register(const RegisterFile &device, uint8_t reg) const;
+  void account(size_t bits);
+
+  int bus_speed;   // Bus clock in Hz, 100000, 400000 or 1000000.
+  bool realtime;   // Sleep for the duration of every transaction.
+  std::map<int, RegisterFile> devices;
+
+  std::atomic<uint64_t> transactions;
+  std::atomic<uint64_t> bytes;
+  std::atomic<uint64_t> bus_time_ns;
+};
+
+}
+
+#endif // I2C_TRANSPORT_H_
@@ -0,0 +1,40 @@
+//
+// Created by ros on 2/3/24.
+//
+
+#ifndef PCA9685_H_
+#define PCA9685_H_
+
+#define BASE_ADDR   0x40
+#define ALLCALL_ADDR 0x70      // Every board with ALLCALL enabled answers this address.
+
+namespace smov {
+
+enum pwm_regs {
+  // Registers / etc.
+  MODE1 = 0x00,
+  MODE2 = 0x01,
+  SUBADR1 = 0x02,              // Enable sub address 1 support.
+  SUBADR2 = 0x03,              // Enable sub address 2 support.
+  SUBADR3 = 0x04,              // Enable sub address 2 support.
+  PRESCALE = 0xFE,
+  CHANNEL_ON_L = 0x06,
+  CHANNEL_ON_H = 0x07,
+  CHANNEL_OFF_L = 0x08,
+  CHANNEL_OFF_H = 0x09,
+  ALL_CHANNELS_ON_L = 0xFA,
+  ALL_CHANNELS_ON_H = 0xFB,
+  ALL_CHANNELS_OFF_L = 0xFC,
+  ALL_CHANNELS_OFF_H = 0xFD,
+  RESTART = 0x80,
+  AUTO_INCREMENT = 0x20,     // Register address auto-increment, needed for block writes.
+  SLEEP = 0x10,              // Enable low power mode.
+  ALLCALL = 0x01,
+  INVRT = 0x10,              // Invert the output control logic.
+  OCH = 0x08,                // Outputs change on ACK instead of on STOP.
+  OUTDRV = 0x04
+};
+
+}
+
+#endif // PCA9685_H_
@@ -0,0 +1,50 @@
+//
+// Created by ros on 2/3/24.
+//
+
+#ifndef SERVO_TABLE_H_
+#define SERVO_TABLE_H_
+
+#include <cstdint>
+#include <vector>
+
+#define TABLE_MAX_SERVOS (16*62)
+
+namespace smov {
+
+// Configuration of the servos in use, one dense slot per configured servo stored as a structure of arrays.
+// A robot configures a dozen of the 992 servo numbers: the columns stay small enough to live in cache, and the
+// conversion runs over contiguous arrays. Servo numbers are mapped to their slot by a sparse index.
+class ServoTable {
+ public:
+  ServoTable();
+
+  // Returns the slot of a servo (1..992), or -1 if it has none.
+  int find(int servo) const;
+  // Returns the slot of a servo (1..992), adding an unconfigured one if it has none.
+  int insert(int servo);
+  void clear();
+  int size() const;
+
+  // Sets the calibration of a servo (1..992) and precomputes its conversion, returns false if it was already set.
+  bool configure(int servo, int center, int range, int direction);
+
+  // Servo number, configuration and precomputed conversion of each slot: count = scale * value + offset, clamped
+  // to low..high. Center and range are -1 until the servo is configured, mode_pos is -1 until it is positioned.
+  std::vector<int> servo;
+  std::vector<int> center;
+  std::vector<int> range;
+  std::vector<int> direction;
+  std::vector<int> mode_pos;
+  std::vector<float> scale;
+  std::vector<float> offset;
+  std::vector<float> low;
+  std::vector<float> high;
+
+ private:
+  int16_t slots[TABLE_MAX_SERVOS]; // Slot of each servo number - 1, -1 when it has none.
+};
+
+} // namespace smov
+
+#endif // SERVO_TABLE_H_
@@ -33,6 +33,9 @@ int main(int argc, char **argv) {
   board_handler->init(io_device, 50);    // Loads parameters and performs initialization.
 
   rclcpp::spin(board_handler->board_node);
+  board_handler->board_node->stop_writer();
+
+  board_handler->dump_metrics();
 
   close(io_device);
   rclcpp::shutdown();
@@ -0,0 +1,33 @@
+//
+// Created by ros on 2/3/24.
+//
+
+#include <rclcpp_components/register_node_macro.hpp>
+
+#include "board_component.h"
+
+namespace smov {
+
+BoardComponent::BoardComponent(const rclcpp::NodeOptions &options) {
+  this->board_handler = std::make_shared<smov::BoardHandler>("smov_board", options);
+
+  // Same meaning as the command line argument of the controller: 1 is the front board on /dev/i2c-1, anything else
+  // is the back board on /dev/i2c-N.
+  int board_number = static_cast<int>(this->board_handler->board_node->declare_parameter("board_number", 1));
+
+  this->board_handler->set_handlers(board_number);
+  this->board_handler->init(board_number, 50);    // Loads parameters and performs initialization.
+}
+
+BoardComponent::~BoardComponent() {
+  this->board_handler->board_node->stop_writer();
+  this->board_handler->dump_metrics();
+}
+
+rclcpp::node_interfaces::NodeBaseInterface::SharedPtr BoardComponent::get_node_base_interface() const {
+  return this->board_handler->board_node->get_node_base_interface();
+}
+
+}
+
+RCLCPP_COMPONENTS_REGISTER_NODE(smov::BoardComponent)
@@ -15,18 +15,14 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <cmath>
-#include <fcntl.h>
-#include <sys/ioctl.h>
-
-extern "C" {
-#include <linux/i2c.h>
-#include <linux/i2c-dev.h>
-#include <i2c/smbus.h>
-}
+#include <pthread.h>
+#include <sched.h>
 
 #include <rclcpp/logging.hpp>
 
@@ -37,13 +33,47 @@ extern "C" {
 
 namespace smov {
 
-BoardNode::BoardNode(const std::string &node_name, const std::string &node_namespace) : rclcpp::Node(node_name,
-                                                                                                     node_namespace) {
+static_assert(METRICS_MAX_BOARDS == MAX_BOARDS, "The metrics must cover every board");
+static_assert(TABLE_MAX_SERVOS == MAX_SERVOS, "The servo table must map every servo number");
+
+/**
+ * \private Function returning the steady clock in nanoseconds, used to time frames across threads.
+ */
+static int64_t steady_now_ns() {
+  auto now = std::chrono::steady_clock::now().time_since_epoch();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+BoardNode::BoardNode(const std::string &node_name,
+                     const std::string &node_namespace,
+                     const rclcpp::NodeOptions &options) : rclcpp::Node(node_name, node_namespace, options) {
   this->last_servo = -1;
   this->active_board = 0;
   this->pwm_frequency = 50;
-  this->controller_io_handle = 0;
   this->controller_io_device = 0;
+  this->staged_boards = 0;
+  this->bus_boards = MAX_BOARDS;
+  this->board_count = 0;
+  this->stagger_pulses = false;
+  this->atomic_frames = true;
+  this->exclusive_buses = true;
+  this->verify_period_ms = 0;
+  this->servo_table = std::make_shared<const smov::ServoTable>();
+}
+
+BoardNode::~BoardNode() {
+  this->stop_writer();
+
+  for (auto &bus : this->buses) {
+    auto *simulated = dynamic_cast<const smov::SimulatedI2cTransport *>(bus->transport.get());
+    if (simulated != nullptr)
+      RCLCPP_INFO(rclcpp::get_logger("rclcpp"),
+                  "Simulated I2C bus: %llu transactions, %llu bytes, %.3f ms of bus time at %d Hz",
+                  static_cast<unsigned long long>(simulated->get_transactions()),
+                  static_cast<unsigned long long>(simulated->get_bytes()),
+                  static_cast<double>(simulated->get_bus_time_ns()) / 1000000.0,
+                  simulated->get_bus_speed());
+  }
 }
 
 /**
@@ -86,46 +116,70 @@ float BoardNode::convert_mps_to_proportional(float speed) {
 /**
  * \private Method to set a pulse frequency.
  *
- * The pulse defined by start/stop will be active on all channels until any subsequent call changes it.
+ * The prescaler of every board brought up is reprogrammed in the background, boards brought up later start with it.
  * @param frequency an int value (1..15000) indicating the pulse frequency where 50 is typical for RC servos
  * Example set_frequency (68)  // set the pulse frequency to 68Hz
  */
 void BoardNode::set_pwm_frequency(int freq) {
-  int prescale;
-  char old_mode, new_mode;
-
   this->pwm_frequency = freq;   // Save to global.
 
-  RCLCPP_DEBUG(rclcpp::get_logger("rclcpp"), "_set_pwm_frequency prescale");
+  RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Setting PWM frequency to %d Hz", freq);
+
+  uint64_t boards = 0;
+  for (int board = 0; board < MAX_BOARDS; board++)
+    if (this->pwm_boards[board] > 0)
+      boards |= 1ull << board;
+  this->request_setup(boards);
+}
 
+/**
+ * \private Method to get the prescaler value of the current pulse frequency.
+ */
+int BoardNode::get_prescale() const {
   float prescale_val = 25000000.0; // 25MHz.
   prescale_val /= 4096.0;
-  prescale_val /= (float) freq;
+  prescale_val /= (float) this->pwm_frequency;
   prescale_val -= 1.0;
-  prescale = floor(prescale_val + 0.5);
-
-  RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Setting PWM frequency to %d Hz", freq);
+  return std::min(std::max(static_cast<int>(floor(prescale_val + 0.5)), 3), 255);
+}
 
-  const struct timespec timespec1 = {1, 000000L};
-  nanosleep(&timespec1, nullptr);
+/**
+ * \private Method to program the prescaler of a board, unless it already runs at the current frequency. The bus
+ * must be locked.
+ *
+ * The prescaler can only be written while the oscillator sleeps, it then needs 500 microseconds to settle before the
+ * PWM outputs are restarted.
+ * @param board An int value (1..62) indicating which board to program.
+ */
+void BoardNode::program_prescaler(int board) {
+  int prescale = this->get_prescale();
+  if (this->board_prescale[board - 1] == prescale)
+    return;
 
-  old_mode = i2c_smbus_read_byte_data(this->controller_io_handle, smov::MODE1);
-  new_mode = (old_mode & 0x7F) | 0x10; // Sleep.
+  int old_mode = this->read_register(board, smov::MODE1);
+  if (old_mode < 0) {
+    RCLCPP_ERROR(rclcpp::get_logger("rclcpp"), "Unable to read PWM controller mode of board %d", board);
+    return;
+  }
+  old_mode &= ~smov::RESTART;
 
-  if (0 > i2c_smbus_write_byte_data(this->controller_io_handle, smov::MODE1, new_mode))
+  if (0 > this->write_register(board, smov::MODE1, static_cast<uint8_t>(old_mode | smov::SLEEP)))
     RCLCPP_ERROR(rclcpp::get_logger("rclcpp"), "Unable to set PWM controller to sleep mode");
 
-  if (0 > i2c_smbus_write_byte_data(this->controller_io_handle, smov::PRESCALE, (prescale)))
+  if (0 > this->write_register(board, smov::PRESCALE, static_cast<uint8_t>(prescale)))
     RCLCPP_ERROR(rclcpp::get_logger("rclcpp"), "Unable to set PWM controller prescale");
 
-  if (0 > i2c_smbus_write_byte_data(this->controller_io_handle, smov::MODE1, old_mode))
+  if (0 > this->write_register(board, smov::MODE1, static_cast<uint8_t>(old_mode & ~smov::SLEEP)))
     RCLCPP_ERROR(rclcpp::get_logger("rclcpp"), "Unable to set PWM controller to active mode");
 
-  const struct timespec timespec2 = {0, 5000000L};
-  nanosleep(&timespec2, nullptr);   // Sleep 5 microseconds.
+  const struct timespec settle = {0, 500000L};
+  nanosleep(&settle, nullptr);   // Sleep 500 microseconds, wait for the oscillator.
 
-  if (0 > i2c_smbus_write_byte_data(this->controller_io_handle, smov::MODE1, old_mode | 0x80))
+  if (0 > this->write_register(board, smov::MODE1, static_cast<uint8_t>((old_mode & ~smov::SLEEP) | smov::RESTART))) {
     RCLCPP_ERROR(rclcpp::get_logger("rclcpp"), "Unable to restore PWM controller to active mode");
+    return;
+  }
+  this->board_prescale[board - 1] = prescale;
 }
 
 /**
@@ -145,76 +199,232 @@ void BoardNode::set_pwm_interval_all(int start, int end) {
     return;
   }
 
-  if (0 > i2c_smbus_write_byte_data(this->controller_io_handle, smov::ALL_CHANNELS_ON_L, start & 0xFF))
-    RCLCPP_ERROR(rclcpp::get_logger("rclcpp"),
-                 "Error setting PWM start low byte for all servos on board %d",
-                 this->active_board);
-  if (0 > i2c_smbus_write_byte_data(this->controller_io_handle, smov::ALL_CHANNELS_ON_H, start >> 8))
-    RCLCPP_ERROR(rclcpp::get_logger("rclcpp"),
-                 "Error setting PWM start high byte for all servos on board %d",
-                 this->active_board);
-  if (0 > i2c_smbus_write_byte_data(this->controller_io_handle, smov::ALL_CHANNELS_OFF_L, end & 0xFF))
-    RCLCPP_ERROR(rclcpp::get_logger("rclcpp"),
-                 "Error setting PWM end low byte for all servos on board %d",
-                 this->active_board);
-  if (0 > i2c_smbus_write_byte_data(this->controller_io_handle, smov::ALL_CHANNELS_OFF_H, end >> 8))
+  std::lock_guard<std::recursive_mutex> lock(this->get_bus(this->active_board).bus_mutex);
+  this->write_all_channels(this->active_board, start, end);
+}
+
+/**
+ * \private Method to set a common value for all PWM channels of a board. The bus must be locked.
+ *
+ * @param board an int value (1..62) indicating the board to write to.
+ * @param start an int value (0..4096) indicating when the pulse will go high sending power to each channel.
+ * @param end an int value (0..4096) indicating when the pulse will go low stoping power to each channel.
+ */
+void BoardNode::write_all_channels(int board, int start, int end) {
+  // Auto-increment covers the four ALL_LED registers in one transaction.
+  uint8_t values[4] = {static_cast<uint8_t>(start & 0xFF), static_cast<uint8_t>(start >> 8),
+                       static_cast<uint8_t>(end & 0xFF), static_cast<uint8_t>(end >> 8)};
+  if (!this->get_bus(board).transport->write(this->get_board_address(board), smov::ALL_CHANNELS_ON_L, values, 4)) {
     RCLCPP_ERROR(rclcpp::get_logger("rclcpp"),
-                 "Error setting PWM end high byte for all servos on board %d",
-                 this->active_board);
+                 "Error setting PWM for all servos on board %d",
+                 board);
+    this->metrics.record_board_error(board);
+    this->shadow_mask[board - 1] = 0;
+    return;
+  }
+
+  // Every channel of the board now holds the same value.
+  int first = (board - 1) * 16;
+  std::fill_n(&this->shadow_on[first], 16, static_cast<uint16_t>(start));
+  std::fill_n(&this->shadow_off[first], 16, static_cast<uint16_t>(end));
+  this->shadow_mask[board - 1] = 0xFFFF;
+}
+
+/**
+ * \private Method to set a value for all PWM channels of every board at once.
+ *
+ * A single transaction to the ALLCALL address of each bus reaches every board on it, whatever their number. The frames
+ * of a bus that were not written yet are dropped first, as the broadcast supersedes them.
+ *
+ * Only the boards brought up by the controller are updated, boards that were not are still asleep from reset and are
+ * zeroed when brought up. A bus shared with boards driven by another controller (i2c_bus_exclusive set to false) is
+ * only broadcast to once every board on it was brought up. A bus is never broadcast to with a board brought up at or
+ * past the ALLCALL address, board 49 of a bus sitting at 0x70.
+ * @param start an int value (0..4096) indicating when the pulse will go high sending power to each channel.
+ * @param end an int value (0..4096) indicating when the pulse will go low stoping power to each channel.
+ * @returns The mask of the boards brought up that the broadcast did not reach, 0 if it reached them all.
+ */
+uint64_t BoardNode::set_pwm_interval_broadcast(int start, int end) {
+  uint8_t values[4] = {static_cast<uint8_t>(start & 0xFF), static_cast<uint8_t>(start >> 8),
+                       static_cast<uint8_t>(end & 0xFF), static_cast<uint8_t>(end >> 8)};
+  uint64_t missed = 0;
+
+  for (auto &bus : this->buses) {
+    uint64_t ready = 0;
+    bool reachable = true;
+    for (int board = 0; board < MAX_BOARDS; board++) {
+      if (((bus->boards & (1ull << board)) == 0) || (this->pwm_boards[board] <= 0))
+        continue;
+      ready |= 1ull << board;
+      if (this->get_board_address(board + 1) >= ALLCALL_ADDR)
+        reachable = false;
+    }
+    if (!this->exclusive_buses && (ready != bus->boards))
+      reachable = false;
+    if (ready == 0)
+      continue;
+    if (!reachable) {
+      missed |= ready;
+      continue;
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(bus->bus_mutex);
+    {
+      std::lock_guard<std::mutex> wake_lock(bus->wake_mutex);
+      bus->pending_boards = 0;
+    }
+    for (int board = 0; board < MAX_BOARDS; board++)
+      if (bus->boards & (1ull << board))
+        this->mailboxes[board].take();
+
+    bool written = bus->transport->write(ALLCALL_ADDR, smov::ALL_CHANNELS_ON_L, values, 4);
+    if (!written)
+      RCLCPP_ERROR(rclcpp::get_logger("rclcpp"), "Error broadcasting PWM for all servos on %s",
+                   bus->transport->get_name().c_str());
+
+    for (int board = 0; board < MAX_BOARDS; board++) {
+      if ((ready & (1ull << board)) == 0)
+        continue;
+      if (!written) {
+        this->shadow_mask[board] = 0;
+        missed |= 1ull << board;
+        continue;
+      }
+      std::fill_n(&this->shadow_on[board * 16], 16, static_cast<uint16_t>(start));
+      std::fill_n(&this->shadow_off[board * 16], 16, static_cast<uint16_t>(end));
+      this->shadow_mask[board] = 0xFFFF;
+      this->metrics.writes_issued += 16;
+    }
+  }
+  return missed;
 }
 
 /**
  * \private Method to set the active board.
  *
+ * Selecting a board does not touch the bus, the transport addresses every board directly. A board selected for the
+ * first time is brought up in the background.
  * @param board An int value (1..62) indicating which board to activate for subsequent service and topic subscription activity where 1 coresponds to the default board address of 0x40 and value increment up.
  * Example set_active_board (68)   // set the pulse frequency to 68Hz.
  */
 void BoardNode::set_active_board(int board) {
-  char mode1res;
-
-  if ((board < 1) || (board > 62)) {
+  if ((board < 1) || (board > this->board_count)) {
     RCLCPP_ERROR(rclcpp::get_logger("rclcpp"),
-                 "Internal error :: invalid board number %d :: board numbers must be between 1 and 62",
-                 board);
+                 "Internal error :: invalid board number %d :: board numbers must be between 1 and %d",
+                 board,
+                 this->board_count);
     return;
   }
 
-  if (this->active_board != board) {
-    this->active_board = board;   // Save to global.
+  this->active_board = board;   // Save to global.
 
-    // the public API is ONE based and hardware is ZERO based.
-    board--;
+  // The public API is ONE based and hardware is ZERO based.
+  if (this->pwm_boards[board - 1] < 0)
+    this->request_setup(1ull << (board - 1));
+}
 
-    if (0 > ioctl(this->controller_io_handle, I2C_SLAVE, (BASE_ADDR + (board)))) {
-      RCLCPP_FATAL(rclcpp::get_logger("rclcpp"),
-                   "Failed to acquire bus access and/or talk to I2C slave at address 0x%02X",
-                   (BASE_ADDR + board));
-      return;
+/**
+ * \private Method to have boards brought up, or their prescaler reprogrammed if they are already up.
+ *
+ * The work is handed to the writer thread like a frame, so the executor never waits on the oscillator. Without the
+ * writer thread it is done right away.
+ * @param boards the mask of the boards, bit 0 being board 1.
+ */
+void BoardNode::request_setup(uint64_t boards) {
+  for (auto &bus : this->buses) {
+    uint64_t bus_setup = boards & bus->boards;
+    if (bus_setup == 0)
+      continue;
+
+    {
+      std::lock_guard<std::mutex> lock(bus->wake_mutex);
+      bus->pending_setup |= bus_setup;
     }
 
-    if (pwm_boards[board] < 0) {
-      pwm_boards[board] = 1;
-      if (0 > i2c_smbus_write_byte_data(this->controller_io_handle, smov::MODE2, smov::OUTDRV))
-        RCLCPP_ERROR(rclcpp::get_logger("rclcpp"), "Failed to enable PWM outputs for totem-pole structure");
+    if (bus->writer.joinable()) {
+      bus->wake_condition.notify_one();
+    } else {
+      std::lock_guard<std::recursive_mutex> lock(bus->bus_mutex);
+      this->write_pending_frames(*bus);
+    }
+  }
+}
 
-      if (0 > i2c_smbus_write_byte_data(this->controller_io_handle, smov::MODE1, smov::ALLCALL))
-        RCLCPP_ERROR(rclcpp::get_logger("rclcpp"), "Failed to enable ALLCALL for PWM channels");
+/**
+ * \private Method to bring a board up. The bus must be locked.
+ *
+ * The prescaler is programmed while the oscillator still sleeps from reset, then the outputs are enabled,
+ * auto-increment is turned on and all of its channels are set to 0.
+ * @param board An int value (1..62) indicating which board to initialize.
+ */
+void BoardNode::init_board(int board) {
+  // Mark the board even when it fails, so a missing board does not get re-initialized on every frame.
+  this->pwm_boards[board - 1] = 1;
+  this->board_prescale[board - 1] = -1;
 
-      const struct timespec timespec3 = {0, 5000000L};
-      nanosleep(&timespec3, nullptr);   // Sleep 5 microseconds, wait for osci.
+  // With OCH cleared the outputs change on the I2C STOP, so every channel of a transaction commits at once.
+  uint8_t mode2 = this->atomic_frames ? smov::OUTDRV : (smov::OUTDRV | smov::OCH);
+  if (0 > this->write_register(board, smov::MODE2, mode2))
+    RCLCPP_ERROR(rclcpp::get_logger("rclcpp"), "Failed to enable PWM outputs for totem-pole structure");
 
-      mode1res = i2c_smbus_read_byte_data(this->controller_io_handle, smov::MODE1);
-      mode1res = mode1res & ~smov::SLEEP;
+  // Auto-increment lets a single transaction cover several consecutive channel registers.
+  if (0 > this->write_register(board, smov::MODE1, smov::ALLCALL | smov::AUTO_INCREMENT | smov::SLEEP))
+    RCLCPP_ERROR(rclcpp::get_logger("rclcpp"), "Failed to enable ALLCALL and auto-increment for PWM channels");
 
-      if (0 > i2c_smbus_write_byte_data(this->controller_io_handle, smov::MODE1, mode1res))
-        RCLCPP_ERROR(rclcpp::get_logger("rclcpp"), "Failed to recover from low power mode");
+  // Wakes the oscillator up, waits for it to settle and restarts the outputs.
+  this->program_prescaler(board);
 
-      nanosleep(&timespec3, nullptr);   // Sleep 5 microseconds, wait for osci/
+  // The first time we activate a board, we mark it and set all of its servo channels to 0.
+  this->write_all_channels(board, 0, 0);
+}
 
-      // The first time we activate a board, we mark it and set all of its servo channels to 0.
-      this->set_pwm_interval_all(0, 0);
-    }
+/**
+ * \private Method to get the 7 bit I2C address of a board.
+ *
+ * @param board An int value (1..62), where the first board of each bus coresponds to the default board address of 0x40.
+ */
+int BoardNode::get_board_address(int board) const {
+  return BASE_ADDR + (board - 1) % this->bus_boards;
+}
+
+/**
+ * \private Method to get the bus a board is on.
+ *
+ * @param board An int value (1..62), a board reachable on one of the buses.
+ */
+smov::BoardBus &BoardNode::get_bus(int board) {
+  return *this->buses[(board - 1) / this->bus_boards];
+}
+
+/**
+ * \private Method to write a single register of a board.
+ *
+ * @returns 0 on success, a negative value on failure.
+ */
+int BoardNode::write_register(int board, uint8_t reg, uint8_t value) {
+  if ((board < 1) || (board > this->board_count))
+    return -1;
+  if (!this->get_bus(board).transport->write(this->get_board_address(board), reg, &value, 1)) {
+    this->metrics.record_board_error(board);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * \private Method to read a single register of a board.
+ *
+ * @returns The register value, or a negative value on failure.
+ */
+int BoardNode::read_register(int board, uint8_t reg) {
+  uint8_t value;
+  if ((board < 1) || (board > this->board_count))
+    return -1;
+  if (!this->get_bus(board).transport->read(this->get_board_address(board), reg, &value, 1)) {
+    this->metrics.record_board_error(board);
+    return -1;
   }
+  return value;
 }
 
 /**
@@ -227,93 +437,422 @@ void BoardNode::set_active_board(int board) {
  *Example set_pwm_interval (3, 0, 350)    // set servo #3 (fourth position on the hardware board) with a pulse of 350
  */
 void BoardNode::set_pwm_interval(int servo, int start, int end) {
-  RCLCPP_DEBUG(rclcpp::get_logger("rclcpp"), "_set_pwm_interval enter");
+  this->stage_pwm_interval(servo, start, end);
+  this->write_pwm_frame();
+}
+
+/**
+ * \private Method to set a value for a PWM channel, based on a range of ±1.0, on the active board.
+ *
+ * The pulse defined by start/stop will be active on the specified servo channel until any subsequent call changes it.
+ * @param servo an int value (1..16) indicating which channel to change power.
+ * @param value an int value (±1.0) indicating when the size of the pulse for the channel.
+ * Example _set_pwm_interval (3, 0, 350)    // set servo #3 (fourth position on the hardware board) with a pulse of 350.
+ */
+void BoardNode::set_pwm_interval_proportional(int servo, float value) {
+  if (this->stage_pwm_interval_proportional(servo, value))
+    this->write_pwm_frame();
+}
 
+/**
+ * \private Method to add a PWM channel value to the frame being assembled, without touching the bus.
+ *
+ * Staged values are sent by write_pwm_frame(), which groups them per board into block transactions. A channel keeps
+ * its value in the following frames until it is staged again.
+ * @param servo an int value (1..992) indicating which channel to change power.
+ * @param start an int value (0..4096) indicating when the pulse will go high sending power to each channel.
+ * @param end an int value (0..4096) indicating when the pulse will go low stoping power to each channel.
+ */
+void BoardNode::stage_pwm_interval(int servo, int start, int end) {
   if ((servo < 1) || (servo > (MAX_SERVOS))) {
     RCLCPP_ERROR(rclcpp::get_logger("rclcpp"),
                  "Invalid servo number %d :: servo numbers must be between 1 and %d",
                  servo,
-                 MAX_BOARDS);
+                 MAX_SERVOS);
     return;
   }
 
-  int board = ((int) ((servo - 1) / 16)) + 1;    // servo 1..16 is board #1, servo 17..32 is board #2, etc.
-  this->set_active_board(board);
+  // The public API is ONE based and hardware is ZERO based.
+  int board = (servo - 1) / 16;    // Servo 1..16 is board #0, servo 17..32 is board #1, etc.
+  int channel = (servo - 1) % 16;  // The hardware enumerates servos as 0..15.
+  if (board >= this->board_count) {
+    RCLCPP_ERROR(rclcpp::get_logger("rclcpp"),
+                 "Invalid servo number %d :: board %d is not on any bus",
+                 servo,
+                 board + 1);
+    return;
+  }
 
-  servo = ((servo - 1) % 16) + 1;                // servo numbers are 1..16.
+  // Each channel switches on at its own tick, so the servos of a board do not all draw current at the same time.
+  // Full OFF (0) and full ON (4096) pulses have no edge to move.
+  if (this->stagger_pulses && (start == 0) && (end > 0) && (end < 4096)) {
+    start = channel * PWM_STAGGER_STEP;
+    end = (start + end) % 4096;
+  }
 
-  // the public API is ONE based and hardware is ZERO based.
-  board = this->active_board - 1;                    // the hardware enumerates boards as 0..61.
-  int channel = servo - 1;                      // the hardware enumerates servos as 0..15.
-  RCLCPP_DEBUG(rclcpp::get_logger("rclcpp"), "_set_pwm_interval board=%d servo=%d", board, servo);
+  this->frame_on[servo - 1] = static_cast<uint16_t>(start);
+  this->frame_off[servo - 1] = static_cast<uint16_t>(end);
+  this->frame_mask[board] |= static_cast<uint16_t>(1u << channel);
+  if ((this->staged_boards & (1ull << board)) == 0)
+    this->frame_stamp[board] = steady_now_ns();
+  this->staged_boards |= 1ull << board;
+}
 
-  if (0 > i2c_smbus_write_byte_data(this->controller_io_handle, smov::CHANNEL_ON_L + 4 * channel, start & 0xFF))
-    RCLCPP_ERROR(rclcpp::get_logger("rclcpp"),
-                 "Error setting PWM start low byte on servo %d on board %d",
-                 servo,
-                 this->active_board);
-  if (0 > i2c_smbus_write_byte_data(this->controller_io_handle, smov::CHANNEL_ON_H + 4 * channel, start >> 8))
-    RCLCPP_ERROR(rclcpp::get_logger("rclcpp"),
-                 "Error setting PWM start high byte on servo %d on board %d",
-                 servo,
-                 this->active_board);
-  if (0 > i2c_smbus_write_byte_data(this->controller_io_handle, smov::CHANNEL_OFF_L + 4 * channel, end & 0xFF))
-    RCLCPP_ERROR(rclcpp::get_logger("rclcpp"),
-                 "Error setting PWM end low byte on servo %d on board %d",
-                 servo,
-                 this->active_board);
-  if (0 > i2c_smbus_write_byte_data(this->controller_io_handle, smov::CHANNEL_OFF_H + 4 * channel, end >> 8))
-    RCLCPP_ERROR(rclcpp::get_logger("rclcpp"),
-                 "Error setting PWM end high byte on servo %d on board %d",
-                 servo,
-                 this->active_board);
+/**
+ * \private Method to add a proportional (±1.0) PWM channel value to the frame being assembled.
+ *
+ * @param servo an int value (1..992) indicating which channel to change power.
+ * @param value a float value (±1.0) indicating the size of the pulse for the channel, saturated to the servo travel.
+ * @returns True if the value was staged, false if the servo is invalid or not configured.
+ */
+bool BoardNode::stage_pwm_interval_proportional(int servo, float value) {
+  return this->stage_pwm_intervals_proportional(&servo, &value, 1) == 1;
 }
 
 /**
- * \private Method to set a value for a PWM channel, based on a range of ±1.0, on the active board.
+ * \private Method to add an array of proportional (±1.0) PWM channel values to the frame being assembled.
  *
- * The pulse defined by start/stop will be active on the specified servo channel until any subsequent call changes it.
- * @param servo an int value (1..16) indicating which channel to change power.
- * @param value an int value (±1.0) indicating when the size of the pulse for the channel.
- * Example _set_pwm_interval (3, 0, 350)    // set servo #3 (fourth position on the hardware board) with a pulse of 350.
+ * Values are converted in batches by convert_proportional(). Values outside of ±1.0 saturate at the end of the servo
+ * travel instead of being rejected.
+ * @param servos the servo numbers (1..992).
+ * @param values the proportional values (±1.0) of each servo.
+ * @param count an int value indicating the number of servos.
+ * @returns The number of values staged, servos that are invalid or not configured are skipped.
  */
-void BoardNode::set_pwm_interval_proportional(int servo, float value) {
-  if ((value < -1.0001) || (value > 1.0001)) {
-    RCLCPP_ERROR(rclcpp::get_logger("rclcpp"),
-                 "Invalid proportion value %f :: proportion values must be between -1.0 and 1.0",
-                 value);
-    return;
+int BoardNode::stage_pwm_intervals_proportional(const int *servos, const float *values, int count) {
+  static constexpr int BATCH = 64;
+  std::shared_ptr<const smov::ServoTable> table = std::atomic_load(&this->servo_table);
+  int index[BATCH];
+  float batch[BATCH];
+  uint16_t counts[BATCH];
+  int staged = 0;
+
+  for (int first = 0; first < count; first += BATCH) {
+    int size = std::min(BATCH, count - first);
+
+    // Invalid servos are filtered out first, so the conversion itself runs without branches.
+    int valid = 0;
+    for (int i = 0; i < size; i++) {
+      int servo = servos[first + i];
+      if ((servo < 1) || (servo > (MAX_SERVOS))) {
+        RCLCPP_ERROR(rclcpp::get_logger("rclcpp"),
+                     "Invalid servo number %d :: servo numbers must be between 1 and %d",
+                     servo,
+                     MAX_SERVOS);
+        continue;
+      }
+      int slot = table->find(servo);
+      if ((slot < 0) || (table->center[slot] < 0) || (table->range[slot] < 0)) {
+        RCLCPP_ERROR(rclcpp::get_logger("rclcpp"), "Missing servo configuration for servo[%d]", servo);
+        continue;
+      }
+      index[valid] = slot;
+      batch[valid] = values[first + i];
+      valid++;
+    }
+
+    this->convert_proportional(*table, index, batch, counts, valid);
+
+    for (int i = 0; i < valid; i++)
+      this->stage_pwm_interval(table->servo[index[i]], 0, counts[i]);
+    staged += valid;
   }
+  return staged;
+}
 
-  smov::ServoConfig *configp = &(this->servo_configs[servo - 1]);
+/**
+ * \private Method to convert proportional (±1.0) values to OFF counts with the precomputed servo coefficients.
+ *
+ * The loop holds no branch, so the compiler can vectorize it. A value is clamped to ±1.0 (NaN counts as 0.0), then
+ * the count is clamped to the servo travel within 0..4095.
+ * @param table the servo table the slots belong to.
+ * @param index the servo table slots, all configured.
+ * @param values the proportional values of each servo.
+ * @param counts receives the OFF count of each servo.
+ * @param count an int value indicating the number of servos.
+ */
+void BoardNode::convert_proportional(const smov::ServoTable &table,
+                                     const int *index,
+                                     const float *values,
+                                     uint16_t *counts,
+                                     int count) const {
+  const float *scale = table.scale.data();
+  const float *offset = table.offset.data();
+  const float *low = table.low.data();
+  const float *high = table.high.data();
+
+  for (int i = 0; i < count; i++) {
+    int slot = index[i];
+    float value = values[i];
+    value = (value == value) ? value : 0.0f;
+    value = std::min(std::max(value, -1.0f), 1.0f);
+
+    float position = scale[slot] * value + offset[slot];
+    position = std::min(std::max(position, low[slot]), high[slot]);
+    counts[i] = static_cast<uint16_t>(position);
+  }
+}
 
-  if ((configp->center < 0) || (configp->range < 0)) {
-    RCLCPP_ERROR(rclcpp::get_logger("rclcpp"), "Missing servo configuration for servo[%d]", servo);
+/**
+ * \private Method to hand every staged channel value over to the boards.
+ *
+ * The requested state of each staged board is published in its mailbox. With the writer threads running, this only
+ * wakes up the writer of each bus involved and returns: the buses are written in parallel, and the frame is complete
+ * once the slowest bus is done. Otherwise the frames are written right away, one bus after the other. A board frame
+ * that was not written yet is replaced, so stale intermediate frames are dropped instead of replayed.
+ */
+void BoardNode::write_pwm_frame() {
+  uint64_t boards = this->staged_boards;
+  if (boards == 0)
     return;
+  this->staged_boards = 0;
+
+  // The same value on every channel of every board is a single broadcast per bus, and supersedes any pending frame.
+  // Only the boards of a bus where it failed are then written one by one.
+  uint16_t start, end;
+  if (this->is_uniform_frame(boards, start, end)) {
+    boards = this->set_pwm_interval_broadcast(start, end);
+    if (boards == 0)
+      return;
+  }
+
+  for (int board = 0; board < MAX_BOARDS; board++) {
+    if ((boards & (1ull << board)) == 0)
+      continue;
+
+    int first = board * 16;
+    smov::PwmFrame &frame = this->mailboxes[board].get_back();
+    std::copy_n(&this->frame_on[first], 16, frame.on);
+    std::copy_n(&this->frame_off[first], 16, frame.off);
+    frame.mask = this->frame_mask[board];
+    frame.stamp = this->frame_stamp[board];
+
+    if (!this->mailboxes[board].publish())
+      this->metrics.frames_replaced++;
+  }
+
+  for (auto &bus : this->buses) {
+    uint64_t bus_frames = boards & bus->boards;
+    if (bus_frames == 0)
+      continue;
+
+    {
+      std::lock_guard<std::mutex> lock(bus->wake_mutex);
+      bus->pending_boards |= bus_frames;
+    }
+
+    if (bus->writer.joinable()) {
+      bus->wake_condition.notify_one();
+    } else {
+      std::lock_guard<std::recursive_mutex> lock(bus->bus_mutex);
+      this->write_pending_frames(*bus);
+    }
+  }
+}
+
+/**
+ * \private Method to check if the staged boards are exactly the boards brought up, with one value on all channels.
+ *
+ * @param boards the mask of the staged boards.
+ * @param start receives the common ON count.
+ * @param end receives the common OFF count.
+ * @returns True if the frame can be broadcast.
+ */
+bool BoardNode::is_uniform_frame(uint64_t boards, uint16_t &start, uint16_t &end) const {
+  uint64_t active = 0;
+  for (int board = 0; board < MAX_BOARDS; board++)
+    if (this->pwm_boards[board] > 0)
+      active |= 1ull << board;
+  if (boards != active)
+    return false;
+
+  int first = __builtin_ctzll(boards) * 16;
+  start = this->frame_on[first];
+  end = this->frame_off[first];
+  for (int board = 0; board < MAX_BOARDS; board++) {
+    if ((boards & (1ull << board)) == 0)
+      continue;
+    if (this->frame_mask[board] != 0xFFFF)
+      return false;
+    for (int channel = board * 16; channel < (board + 1) * 16; channel++)
+      if ((this->frame_on[channel] != start) || (this->frame_off[channel] != end))
+        return false;
+  }
+  return true;
+}
+
+/**
+ * \private Method to drop every frame that was not written yet, and forget the requested channel values.
+ *
+ * Used before stopping the servos, so a frame queued earlier cannot power them again.
+ */
+void BoardNode::discard_pwm_frames() {
+  this->staged_boards = 0;
+  std::fill_n(this->frame_mask, MAX_BOARDS, 0);
+
+  for (auto &bus : this->buses) {
+    std::lock_guard<std::recursive_mutex> lock(bus->bus_mutex);
+    {
+      std::lock_guard<std::mutex> wake_lock(bus->wake_mutex);
+      bus->pending_boards = 0;
+    }
+    for (int board = 0; board < MAX_BOARDS; board++)
+      if (bus->boards & (1ull << board))
+        this->mailboxes[board].take();
+  }
+}
+
+/**
+ * \private Method to set up the boards of a bus that requested it, then write the latest frame of every board of the
+ * bus that has one pending. The bus must be locked.
+ *
+ * @param bus the bus to write to.
+ */
+void BoardNode::write_pending_frames(smov::BoardBus &bus) {
+  uint64_t boards, setup;
+  {
+    std::lock_guard<std::mutex> lock(bus.wake_mutex);
+    boards = bus.pending_boards;
+    setup = bus.pending_setup;
+    bus.pending_boards = 0;
+    bus.pending_setup = 0;
+  }
+
+  // Boards are brought up, or their frequency changed, before any frame is written to them.
+  for (int board = 0; board < MAX_BOARDS; board++) {
+    if ((setup & (1ull << board)) == 0)
+      continue;
+
+    if (this->pwm_boards[board] < 0)
+      this->init_board(board + 1);
+    else
+      this->program_prescaler(board + 1);
+  }
+
+  for (int board = 0; board < MAX_BOARDS; board++) {
+    if ((boards & (1ull << board)) == 0)
+      continue;
+
+    const smov::PwmFrame *frame = this->mailboxes[board].take();
+    if (frame != nullptr)
+      this->write_board_frame(board + 1, *frame);
+  }
+}
+
+/**
+ * \private Method to write a frame to a board. The bus must be locked.
+ *
+ * Channels whose registers already hold the requested value are dropped. Each remaining run of consecutive channels
+ * is sent as a single auto-increment transaction, so a full 16 channel board costs one bus transaction instead of
+ * 64 byte writes.
+ * @param board an int value (1..62) indicating the board to write to.
+ * @param frame the requested state of the board channels.
+ */
+void BoardNode::write_board_frame(int board, const smov::PwmFrame &frame) {
+  // The public API is ONE based and hardware is ZERO based.
+  if (this->pwm_boards[board - 1] < 0)
+    this->init_board(board);
+
+  // Only keep the channels that differ from the shadow registers.
+  unsigned int mask = 0;
+  int first = (board - 1) * 16;
+  for (int channel = 0; channel < 16; channel++) {
+    unsigned int bit = 1u << channel;
+    if ((frame.mask & bit) == 0)
+      continue;
+    if ((this->shadow_mask[board - 1] & bit) && this->shadow_on[first + channel] == frame.on[channel]
+        && this->shadow_off[first + channel] == frame.off[channel])
+      continue;
+    mask |= bit;
+  }
+
+  // A single transaction commits on a single STOP, so an atomic frame also rewrites the clean channels between the
+  // first and last dirty ones. A gap channel can only be filled when its value is known, otherwise the run splits.
+  uint16_t on[16];
+  uint16_t off[16];
+  std::copy_n(frame.on, 16, on);
+  std::copy_n(frame.off, 16, off);
+  if (this->atomic_frames && (mask != 0)) {
+    unsigned int span = (((1u << (31 - __builtin_clz(mask))) << 1) - 1) & ~((1u << __builtin_ctz(mask)) - 1);
+    unsigned int fill = span & ~static_cast<unsigned int>(frame.mask) & this->shadow_mask[board - 1];
+    for (int channel = 0; channel < 16; channel++) {
+      if (fill & (1u << channel)) {
+        on[channel] = this->shadow_on[first + channel];
+        off[channel] = this->shadow_off[first + channel];
+      }
+    }
+    mask = span & (frame.mask | fill);
+  }
+  this->metrics.writes_skipped += __builtin_popcount(frame.mask & ~mask);
+
+  uint64_t bytes = 0;
+  uint64_t transactions = 0;
+  int channel = 0;
+  while (mask != 0) {
+    while ((mask & 1u) == 0) {
+      mask >>= 1;
+      channel++;
+    }
+
+    int count = 0;
+    while ((mask & 1u) != 0) {
+      mask >>= 1;
+      count++;
+    }
+
+    if (this->write_channels(board, channel, count, &on[channel], &off[channel])) {
+      std::copy_n(&on[channel], count, &this->shadow_on[first + channel]);
+      std::copy_n(&off[channel], count, &this->shadow_off[first + channel]);
+      this->shadow_mask[board - 1] |= static_cast<uint16_t>(((1u << count) - 1) << channel);
+    } else {
+      // The board state is unknown after a failed write, so the next frame rewrites these channels.
+      this->shadow_mask[board - 1] &= static_cast<uint16_t>(~(((1u << count) - 1) << channel));
+    }
+    this->metrics.writes_issued += count;
+    bytes += 1 + 4 * count;   // The register address, then 4 bytes per channel.
+    transactions++;
+    channel += count;
   }
 
-  int pos = static_cast<int>((configp->direction * (((float) (configp->range) / 2) * value)) + configp->center);
+  this->metrics.frame_bytes.record(bytes);
+  this->metrics.frame_transactions.record(transactions);
+  int64_t latency = steady_now_ns() - frame.stamp;
+  if ((frame.stamp != 0) && (latency >= 0))
+    this->metrics.frame_latency_us.record(static_cast<uint64_t>(latency / 1000));
+}
+
+/**
+ * \private Method to write consecutive channels of a board in one transaction.
+ *
+ * @param board an int value (1..62) indicating the board to write to.
+ * @param channel an int value (0..15) indicating the first hardware channel to write.
+ * @param count an int value (1..16) indicating how many consecutive channels to write.
+ * @param on the ON counts of the channels to write.
+ * @param off the OFF counts of the channels to write.
+ * @returns True if every channel was written.
+ */
+bool BoardNode::write_channels(int board, int channel, int count, const uint16_t *on, const uint16_t *off) {
+  uint8_t buffer[1 + 4 * 16];
+
+  buffer[0] = static_cast<uint8_t>(smov::CHANNEL_ON_L + 4 * channel);
+  for (int i = 0; i < count; i++) {
+    buffer[1 + 4 * i] = on[i] & 0xFF;
+    buffer[2 + 4 * i] = on[i] >> 8;
+    buffer[3 + 4 * i] = off[i] & 0xFF;
+    buffer[4 + 4 * i] = off[i] >> 8;
+  }
 
-  if ((pos < 0) || (pos > 4096)) {
+  if (!this->get_bus(board).transport->write(this->get_board_address(board), buffer[0], &buffer[1],
+                                             static_cast<size_t>(4 * count))) {
     RCLCPP_ERROR(rclcpp::get_logger("rclcpp"),
-                 "Invalid computed position servo[%d] = (direction(%d) * ((range(%d) / 2) * value(%6.4f))) + %d = %d",
-                 servo,
-                 configp->direction,
-                 configp->range,
-                 value,
-                 configp->center,
-                 pos);
-    return;
+                 "Error setting PWM of servos %d..%d on board %d",
+                 channel + 1,
+                 channel + count,
+                 board);
+    this->metrics.record_channel_errors(board, channel, count);
+    return false;
   }
-  set_pwm_interval(servo, 0, pos);
-  RCLCPP_DEBUG(rclcpp::get_logger("rclcpp"),
-               "servo[%d] = (direction(%d) * ((range(%d) / 2) * value(%6.4f))) + %d = %d",
-               servo,
-               configp->direction,
-               configp->range,
-               value,
-               configp->center,
-               pos);
+  return true;
 }
 
 /**
@@ -326,12 +865,66 @@ void BoardNode::set_pwm_interval_proportional(int servo, float value) {
  *Example config_server (1, 300, 100, -1)   // configure the first servo with a center of 300 and range of 100 and reversed direction.
  */
 void BoardNode::config_servo(int servo, int center, int range, int direction) {
+  this->config_servos({{servo, center, range, direction}});
+}
+
+/**
+ * \private Method to configure several servos at once.
+ *
+ * The new calibration is applied to a copy of the servo table, which then replaces the current one in a single
+ * atomic swap: frames staged from then on use it, and the bus is never held.
+ * @param calibrations the servo, center, range and direction of each servo.
+ * @returns The number of servos whose calibration changed.
+ */
+int BoardNode::config_servos(const std::vector<smov::ServoCalibration> &calibrations) {
+  auto table = std::make_shared<smov::ServoTable>(*std::atomic_load(&this->servo_table));
+  int changed = 0;
+
+  for (const auto &calibration : calibrations) {
+    if (!this->is_valid_calibration(calibration))
+      continue;
+
+    if (!table->configure(calibration.servo, calibration.center, calibration.range, calibration.direction))
+      continue;
+    changed++;
+
+    if (calibration.servo > last_servo)    // Used for internal optimizations.
+      last_servo = calibration.servo;
+
+    RCLCPP_DEBUG(rclcpp::get_logger("rclcpp"),
+                 "Servo #%d configured: center=%d, range=%d, direction=%d",
+                 calibration.servo,
+                 calibration.center,
+                 calibration.range,
+                 calibration.direction);
+  }
+
+  if (changed > 0)
+    std::atomic_store(&this->servo_table, std::shared_ptr<const smov::ServoTable>(std::move(table)));
+
+  RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "%d servos configured, %d changed", static_cast<int>(calibrations.size()),
+              changed);
+  return changed;
+}
+
+/**
+ * \private Method to check a servo calibration, logging what is wrong with it.
+ *
+ * Only an invalid servo number rejects the calibration, other errors are reported but applied as requested.
+ * @param calibration the servo, center, range and direction of the servo.
+ * @returns False if the servo number is invalid.
+ */
+bool BoardNode::is_valid_calibration(const smov::ServoCalibration &calibration) const {
+  int servo = calibration.servo;
+  int center = calibration.center;
+  int range = calibration.range;
+
   if ((servo < 1) || (servo > (MAX_SERVOS))) {
     RCLCPP_ERROR(rclcpp::get_logger("rclcpp"),
                  "Invalid servo number %d :: servo numbers must be between 1 and %d",
                  servo,
                  MAX_SERVOS);
-    return;
+    return false;
   }
 
   if ((center < 0) || (center > 4096))
@@ -349,20 +942,7 @@ void BoardNode::config_servo(int servo, int center, int range, int direction) {
                  "Invalid range center combination %d ± %d :: range/2 ± center must be between 0 and 4096",
                  center,
                  (range / 2));
-
-  this->servo_configs[servo - 1].center = center;
-  this->servo_configs[servo - 1].range = range;
-  this->servo_configs[servo - 1].direction = direction;
-
-  if (servo > last_servo)    // Used for internal optimizations.
-    last_servo = servo;
-
-  RCLCPP_INFO(rclcpp::get_logger("rclcpp"),
-              "Servo #%d configured: center=%d, range=%d, direction=%d",
-              servo,
-              center,
-              range,
-              direction);
+  return true;
 }
 
 int BoardNode::config_servo_position(int servo, int position) {
@@ -379,7 +959,10 @@ int BoardNode::config_servo_position(int servo, int position) {
                  position);
     return -1;
   }
-  this->servo_configs[servo - 1].mode_pos = position;
+  auto table = std::make_shared<smov::ServoTable>(*std::atomic_load(&this->servo_table));
+  table->mode_pos[table->insert(servo)] = position;
+  std::atomic_store(&this->servo_table, std::shared_ptr<const smov::ServoTable>(std::move(table)));
+  this->drive_mixer.set_position(servo, position);
   RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Servo #%d configured: position=%d", servo, position);
   return 0;
 }
@@ -435,6 +1018,7 @@ int BoardNode::config_drive_mode(const std::string &mode, float rpm, float radiu
   this->active_drive.radius = radius;    // The service takes the radius in meters.
   this->active_drive.track = track;        // The service takes the track in meters.
   this->active_drive.scale = scale;
+  this->drive_mixer.configure(mode_val, rpm, radius, track, scale);
 
   RCLCPP_INFO(rclcpp::get_logger("rclcpp"),
               "Drive mode configured: mode=%s, rpm=%6.4f, radius=%6.4f, track=%6.4f, scale=%6.4f",
@@ -446,7 +1030,13 @@ int BoardNode::config_drive_mode(const std::string &mode, float rpm, float radiu
   return 0;
 }
 
-void BoardNode::setup(const char *filename) {
+/**
+ * \private Method to reset the controller state and open the buses.
+ *
+ * @param transports the buses, in the order boards are numbered across them.
+ * @param boards_per_bus an int value (1..62) indicating how many boards each bus holds.
+ */
+void BoardNode::setup(std::vector<std::unique_ptr<smov::I2cTransport>> transports, int boards_per_bus) {
   int i;
 
   for (i = 0; i < MAX_BOARDS; i++) {
@@ -455,13 +1045,7 @@ void BoardNode::setup(const char *filename) {
 
   this->active_board = -1;
 
-  for (i = 0; i < (MAX_SERVOS); i++) {
-    // These values have not useful meaning.
-    this->servo_configs[i].center = -1;
-    this->servo_configs[i].range = -1;
-    this->servo_configs[i].direction = 1;
-    this->servo_configs[i].mode_pos = -1;
-  }
+  std::atomic_store(&this->servo_table, std::make_shared<const smov::ServoTable>());
 
   this->last_servo = -1;
 
@@ -470,13 +1054,199 @@ void BoardNode::setup(const char *filename) {
   this->active_drive.radius = -1.0;
   this->active_drive.track = -1.0;
   this->active_drive.scale = -1.0;
+  this->drive_mixer.clear();
+
+  this->buses.clear();
+  this->bus_boards = boards_per_bus;
+  this->board_count = std::min(MAX_BOARDS, static_cast<int>(transports.size()) * boards_per_bus);
+  for (auto &transport : transports) {
+    auto bus = std::make_unique<smov::BoardBus>();
+    int first = static_cast<int>(this->buses.size()) * boards_per_bus;
+    for (int board = first; (board < first + boards_per_bus) && (board < this->board_count); board++)
+      bus->boards |= 1ull << board;
+    bus->transport = std::move(transport);
+    bus->transport->open_bus();
+    this->buses.push_back(std::move(bus));
+  }
+
+}
+
+/**
+ * \private Method to start the threads writing frames, one per bus.
+ *
+ * @param priority an int value (1..99) to run the threads with SCHED_FIFO at this priority, or 0 to keep the default scheduler.
+ * @param cpu an int value indicating the CPU to pin the writer of the first bus to, the writers of the next buses
+ * are pinned to the next CPUs. -1 lets them run anywhere.
+ */
+void BoardNode::start_writer(int priority, int cpu) {
+  for (size_t index = 0; index < this->buses.size(); index++) {
+    smov::BoardBus *bus = this->buses[index].get();
+    if (bus->writer.joinable())
+      continue;
+
+    bus->writer_running = true;
+    bus->writer = std::thread(&BoardNode::writer_loop, this, bus);
+
+    if (priority > 0) {
+      struct sched_param param = {};
+      param.sched_priority = priority;
+      int error = pthread_setschedparam(bus->writer.native_handle(), SCHED_FIFO, &param);
+      if (error != 0)
+        RCLCPP_WARN(rclcpp::get_logger("rclcpp"),
+                    "Unable to run the I2C writer with SCHED_FIFO priority %d :: %s",
+                    priority,
+                    strerror(error));
+    }
+
+    int bus_cpu = (cpu >= 0) ? cpu + static_cast<int>(index) : -1;
+    if (bus_cpu >= 0) {
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(bus_cpu, &cpus);
+      int error = pthread_setaffinity_np(bus->writer.native_handle(), sizeof(cpus), &cpus);
+      if (error != 0)
+        RCLCPP_WARN(rclcpp::get_logger("rclcpp"), "Unable to pin the I2C writer to CPU %d :: %s", bus_cpu,
+                    strerror(error));
+    }
+
+    RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "I2C writer of %s started (priority=%d, cpu=%d)",
+                bus->transport->get_name().c_str(), priority, bus_cpu);
+  }
+}
+
+void BoardNode::stop_writer() {
+  for (auto &bus : this->buses) {
+    if (!bus->writer.joinable())
+      continue;
 
-  if ((this->controller_io_handle = open(filename, O_RDWR)) < 0) {
-    RCLCPP_FATAL(rclcpp::get_logger("rclcpp"), "Failed to open I2C bus %s", filename);
+    {
+      std::lock_guard<std::mutex> lock(bus->wake_mutex);
+      bus->writer_running = false;
+    }
+    bus->wake_condition.notify_one();
+    bus->writer.join();
+  }
+}
+
+void BoardNode::writer_loop(smov::BoardBus *bus) {
+  auto period = std::chrono::milliseconds(this->verify_period_ms);
+  auto next_verify = std::chrono::steady_clock::now() + period;
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(bus->wake_mutex);
+      auto ready = [bus] {
+        return !bus->writer_running || (bus->pending_boards != 0) || (bus->pending_setup != 0);
+      };
+      if (this->verify_period_ms > 0)
+        bus->wake_condition.wait_until(lock, next_verify, ready);
+      else
+        bus->wake_condition.wait(lock, ready);
+      if (!bus->writer_running)
+        return;
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(bus->bus_mutex);
+    this->write_pending_frames(*bus);
+
+    // The verifier only gets the bus when no frame is waiting, and reads a single board per period.
+    if ((this->verify_period_ms > 0) && (std::chrono::steady_clock::now() >= next_verify)) {
+      bool idle;
+      {
+        std::lock_guard<std::mutex> wake_lock(bus->wake_mutex);
+        idle = (bus->pending_boards == 0) && (bus->pending_setup == 0);
+      }
+      if (idle) {
+        this->verify_next_board(*bus);
+        next_verify = std::chrono::steady_clock::now() + period;
+      }
+    }
+  }
+}
+
+/**
+ * \private Method to verify the next board brought up on a bus, in turn. The bus must be locked.
+ *
+ * @param bus the bus whose boards are verified.
+ */
+void BoardNode::verify_next_board(smov::BoardBus &bus) {
+  for (int i = 0; i < MAX_BOARDS; i++) {
+    bus.verify_board_index = (bus.verify_board_index + 1) % MAX_BOARDS;
+    int board = bus.verify_board_index;
+    if ((bus.boards & (1ull << board)) && (this->pwm_boards[board] > 0)) {
+      this->verify_board(board + 1);
+      return;
+    }
+  }
+}
+
+/**
+ * \private Method to compare the registers of a board with the state the driver wrote, and repair it. The bus must be
+ * locked.
+ *
+ * The mode and channel registers (0x00..0x45) are read in one transaction. A board that went through a reset is
+ * brought up again, and only the channels that differ from the shadow registers are rewritten.
+ * @param board An int value (1..62) indicating which board to verify.
+ */
+void BoardNode::verify_board(int board) {
+  uint8_t regs[smov::CHANNEL_ON_L + 4 * 16];
+  uint16_t expected = this->shadow_mask[board - 1];
+  int first = (board - 1) * 16;
+
+  if (!this->get_bus(board).transport->read(this->get_board_address(board), smov::MODE1, regs, sizeof(regs))) {
+    RCLCPP_ERROR(rclcpp::get_logger("rclcpp"), "Error reading back the registers of board %d", board);
+    this->metrics.record_board_error(board);
     return;
   }
+  this->metrics.boards_verified++;
+
+  // After a reset the board sleeps with auto-increment off, so the channel bytes read are not trustworthy.
+  unsigned int mask = 0;
+  if ((regs[smov::MODE1] & smov::SLEEP) || !(regs[smov::MODE1] & smov::AUTO_INCREMENT)) {
+    RCLCPP_WARN(rclcpp::get_logger("rclcpp"), "Board %d was reset (MODE1=0x%02x), bringing it up again", board,
+                regs[smov::MODE1]);
+    this->metrics.boards_reset++;
+
+    uint16_t on[16], off[16];
+    std::copy_n(&this->shadow_on[first], 16, on);
+    std::copy_n(&this->shadow_off[first], 16, off);
+    this->init_board(board);
+    std::copy_n(on, 16, &this->shadow_on[first]);
+    std::copy_n(off, 16, &this->shadow_off[first]);
+    this->shadow_mask[board - 1] = 0;
+    mask = expected;
+  } else {
+    for (int channel = 0; channel < 16; channel++) {
+      if ((expected & (1u << channel)) == 0)
+        continue;
+      const uint8_t *value = &regs[smov::CHANNEL_ON_L + 4 * channel];
+      if ((value[0] | (value[1] << 8)) != this->shadow_on[first + channel]
+          || (value[2] | (value[3] << 8)) != this->shadow_off[first + channel])
+        mask |= 1u << channel;
+    }
+  }
+
+  int channel = 0;
+  while (mask != 0) {
+    while ((mask & 1u) == 0) {
+      mask >>= 1;
+      channel++;
+    }
+
+    int count = 0;
+    while ((mask & 1u) != 0) {
+      mask >>= 1;
+      count++;
+    }
 
-  RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "I2C bus opened on %s", filename);
+    if (this->write_channels(board, channel, count, &this->shadow_on[first + channel],
+                             &this->shadow_off[first + channel]))
+      this->shadow_mask[board - 1] |= static_cast<uint16_t>(((1u << count) - 1) << channel);
+    else
+      this->shadow_mask[board - 1] &= static_cast<uint16_t>(~(((1u << count) - 1) << channel));
+    this->metrics.channels_repaired += count;
+    channel += count;
+  }
 }
 
 int BoardNode::init(int io_device, int frequency) {
@@ -484,20 +1254,95 @@ int BoardNode::init(int io_device, int frequency) {
   this->controller_io_device = io_device;
   this->pwm_frequency = frequency;
 
-  auto node = std::make_shared<smov::BoardNode>("smov_board_params");
+  // The parameters node is named after the controller, so that several controllers can share a process, and is given
+  // the parameters of the controller, e.g. those of a composed launch.
+  rclcpp::NodeOptions params_options;
+  params_options.parameter_overrides(this->get_node_options().parameter_overrides());
+  auto node = std::make_shared<smov::BoardNode>(std::string(this->get_name()) + "_params",
+                                                this->get_namespace(),
+                                                params_options);
 
   // Default I2C device on RPi2 and RPi3 = "/dev/i2c-1" Orange Pi Lite = "/dev/i2c-0".
   node->declare_parameter("i2c_device_number", this->controller_io_device);
-  std::stringstream device;
-  device << "/dev/i2c-" << this->controller_io_device;
-  this->setup(device.str().c_str());
 
-  this->set_active_board(1);
+  // The simulated transport runs the controller without any board attached, e.g. to measure the driver throughput.
+  std::string transport_name = this->declare_parameter("i2c_transport", std::string("linux"));
+  int bus_speed = static_cast<int>(this->declare_parameter("i2c_bus_speed", 400000));
+  bool simulate_timing = this->declare_parameter("i2c_simulate_timing", true);
+
+  // Several buses can be driven by one controller, each written by its own thread. An empty list keeps the single
+  // i2c_device_number bus.
+  std::vector<int64_t> bus_numbers = this->declare_parameter("i2c_buses", std::vector<int64_t>{});
+  if (bus_numbers.empty())
+    bus_numbers.push_back(this->controller_io_device);
+  int default_bus_boards = bus_numbers.size() > 1 ? 1 : MAX_BOARDS;
+  int boards_per_bus = static_cast<int>(this->declare_parameter("i2c_bus_boards", default_bus_boards));
+
+  // Uniform frames and stops are broadcast to the boards brought up, unless another controller drives boards on the
+  // same buses.
+  this->exclusive_buses = this->declare_parameter("i2c_bus_exclusive", true);
+  if ((boards_per_bus < 1) || (boards_per_bus > MAX_BOARDS)) {
+    RCLCPP_WARN(rclcpp::get_logger("rclcpp"),
+                "Invalid boards per bus %d :: falling back to %d",
+                boards_per_bus,
+                default_bus_boards);
+    boards_per_bus = default_bus_boards;
+  }
+
+  if (transport_name == "simulated") {
+    if (bus_speed <= 0) {
+      RCLCPP_WARN(rclcpp::get_logger("rclcpp"), "Invalid I2C bus speed %d :: falling back to 400000 Hz", bus_speed);
+      bus_speed = 400000;
+    }
+  } else if (transport_name != "linux") {
+    RCLCPP_WARN(rclcpp::get_logger("rclcpp"),
+                "Invalid I2C transport %s :: transport must be one of linux or simulated",
+                transport_name.c_str());
+    transport_name = "linux";
+  }
+
+  std::vector<std::unique_ptr<smov::I2cTransport>> transports;
+  for (int64_t bus_number : bus_numbers) {
+    if (transport_name == "simulated") {
+      RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Simulated I2C bus opened at %d Hz", bus_speed);
+      transports.push_back(std::make_unique<smov::SimulatedI2cTransport>(bus_speed, simulate_timing));
+    } else {
+      std::stringstream device;
+      device << "/dev/i2c-" << bus_number;
+      transports.push_back(std::make_unique<smov::LinuxI2cTransport>(device.str()));
+    }
+  }
+  if (static_cast<int>(transports.size()) * boards_per_bus > MAX_BOARDS)
+    RCLCPP_WARN(rclcpp::get_logger("rclcpp"),
+                "%zu buses of %d boards exceed the %d boards supported :: boards past %d are unreachable",
+                transports.size(),
+                boards_per_bus,
+                MAX_BOARDS,
+                MAX_BOARDS);
+  this->setup(std::move(transports), boards_per_bus);
 
   int pwm = 50;
   node->declare_parameter("pwm_frequency", pwm);
   this->set_pwm_frequency(pwm);
 
+  // Boards read these when they are brought up, so they must be known before the first board is activated. Like every
+  // controller setting, they are declared on the controller node, the parameters node only holds the configuration
+  // files.
+  this->stagger_pulses = this->declare_parameter("pwm_stagger", false);
+  this->atomic_frames = this->declare_parameter("pwm_atomic_frames", true);
+
+  // Bus writes are moved off the executor, so subscription callbacks only publish frames and board bring-up does not
+  // block the node.
+  // The verifier runs on the writer thread, reading back one board per period.
+  this->verify_period_ms = static_cast<int>(this->declare_parameter("verify_period_ms", 1000));
+  bool writer_thread = this->declare_parameter("writer_thread", true);
+  int writer_priority = static_cast<int>(this->declare_parameter("writer_priority", 0));
+  int writer_cpu = static_cast<int>(this->declare_parameter("writer_cpu", -1));
+  if (writer_thread)
+    this->start_writer(writer_priority, writer_cpu);
+
+  this->set_active_board(1);
+
   /*
     // Note: servos are numbered sequentially with '1' being the first servo on board #1, '17' is the first servo on board #2.
     servo_config:
@@ -532,9 +1377,9 @@ int BoardNode::init(int io_device, int frequency) {
 
           if (id && center && direction && range) {
             if ((id >= 1) && (id <= MAX_SERVOS)) {
-              int board = ((int) (id / 16)) + 1;
+              // Each board is brought up once, with the prescaler programmed as part of it.
+              int board = ((id - 1) / 16) + 1;
               this->set_active_board(board);
-              this->set_pwm_frequency(pwm);
               this->config_servo(id, center, range, direction);
             } else
               RCLCPP_WARN(rclcpp::get_logger("rclcpp"), "Parameter servo=%d is out of bounds", id);
@@ -642,10 +1487,26 @@ int BoardNode::get_active_board() const {
   return this->active_board;
 }
 
+int BoardNode::get_pwm_frequency() const {
+  return this->pwm_frequency;
+}
+
 int BoardNode::get_last_servo() const {
   return this->last_servo;
 }
 
+/**
+ * \private Method to get the bus a board is on, e.g. to read the statistics of a simulated bus.
+ *
+ * @param board an int value (1..62) indicating the board.
+ * @returns The transport of the bus, nullptr if the board is not reachable.
+ */
+const smov::I2cTransport *BoardNode::get_transport(int board) const {
+  if ((board < 1) || (board > this->board_count))
+    return nullptr;
+  return this->buses[(board - 1) / this->bus_boards]->transport.get();
+}
+
 smov::DriveMode BoardNode::get_active_drive() const {
   return this->active_drive;
 }
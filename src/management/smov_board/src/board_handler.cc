@@ -2,16 +2,45 @@
 // Created by ros on 2/3/24.
 //
 
+#include <algorithm>
+#include <chrono>
+
 #include "board_handler.h"
 
 namespace smov {
 
-BoardHandler::BoardHandler(const std::string &node_name) {
-  this->board_node = std::make_shared<smov::BoardNode>(node_name);
+BoardHandler::BoardHandler(const std::string &node_name, const rclcpp::NodeOptions &options) {
+  this->board_node = std::make_shared<smov::BoardNode>(node_name, "/", options);
 }
 
 void BoardHandler::init(int io_device, int frequency) {
   this->board_node->init(io_device, frequency);
+
+  // The metrics are published on the standard diagnostics topic, 0 disables it.
+  int period = static_cast<int>(this->board_node->declare_parameter("diagnostics_period_ms", 1000));
+  if (period > 0) {
+    this->diagnostics_pub = this->board_node->create_publisher<diagnostic_msgs::msg::DiagnosticArray>("diagnostics", 10);
+    this->diagnostics_timer = this->board_node->create_wall_timer(std::chrono::milliseconds(period),
+                                                                  std::bind(&BoardHandler::publish_diagnostics, this));
+  }
+
+  // Drive commands are coalesced, the acceleration limits apply to the commanded speeds.
+  this->drive_linear_accel = this->board_node->declare_parameter("drive_linear_accel", 0.0);
+  this->drive_angular_accel = this->board_node->declare_parameter("drive_angular_accel", 0.0);
+  this->start_drive_timer();
+}
+
+/**
+ * \private Method to run the drive mix once per PWM period, so each period takes at most one new drive frame.
+ */
+void BoardHandler::start_drive_timer() {
+  if (this->drive_timer)
+    this->drive_timer->cancel();
+
+  int frequency = std::max(1, this->board_node->get_pwm_frequency());
+  this->drive_tick = std::chrono::steady_clock::now();
+  this->drive_timer = this->board_node->create_wall_timer(std::chrono::microseconds(1000000 / frequency),
+                                                          std::bind(&BoardHandler::drive_tick_handler, this));
 }
 
 void BoardHandler::set_handlers(int board_number) {
@@ -35,6 +64,12 @@ void BoardHandler::set_handlers(int board_number) {
                                                                                                  this,
                                                                                                  std::placeholders::_1)); // The 'proportion' topic will be used for standard servos and continuous rotation aka drive servos.
 
+    this->frame_sub = this->board_node->create_subscription<smov_board_msgs::msg::ServoFrame>("front_servos_frame",
+                                                                                         500,
+                                                                                         std::bind(&BoardHandler::servos_frame_handler,
+                                                                                                   this,
+                                                                                                   std::placeholders::_1)); // The 'frame' topic is the fixed size alternative to the 'proportion' topic.
+
     this->freq_srv = this->board_node->create_service<smov_board_msgs::srv::IntValue>("front_set_pwm_frequency",
                                                                                  std::bind(&BoardHandler::set_pwm_frequency_handler,
                                                                                            this,
@@ -51,7 +86,7 @@ void BoardHandler::set_handlers(int board_number) {
                                                                                       std::placeholders::_1,
                                                                                       std::placeholders::_2));                                         // The 'stop' service can be used at any time.
     this->drive_sub = this->board_node->create_subscription<geometry_msgs::msg::Twist>("front_servos_drive",
-                                                                                       500,
+                                                                                       1,
                                                                                        std::bind(&BoardHandler::servos_drive_handler,
                                                                                                  this,
                                                                                                  std::placeholders::_1));                     // The 'drive' topic will be used for continuous rotation aka drive servos controlled by Twist messages.
@@ -71,6 +106,11 @@ void BoardHandler::set_handlers(int board_number) {
                                                                                        std::bind(&BoardHandler::servos_proportional_handler,
                                                                                                  this,
                                                                                                  std::placeholders::_1));
+    this->frame_sub = this->board_node->create_subscription<smov_board_msgs::msg::ServoFrame>("back_servos_frame",
+                                                                                         500,
+                                                                                         std::bind(&BoardHandler::servos_frame_handler,
+                                                                                                   this,
+                                                                                                   std::placeholders::_1));
 
     this->freq_srv = this->board_node->create_service<smov_board_msgs::srv::IntValue>("back_set_pwm_frequency",
                                                                                  std::bind(&BoardHandler::set_pwm_frequency_handler,
@@ -91,14 +131,17 @@ void BoardHandler::set_handlers(int board_number) {
                                                                                       std::placeholders::_2));
 
     this->drive_sub = this->board_node->create_subscription<geometry_msgs::msg::Twist>("back_servos_drive",
-                                                                                       500,
+                                                                                       1,
                                                                                        std::bind(&BoardHandler::servos_drive_handler,
                                                                                                  this,
                                                                                                  std::placeholders::_1));
   }
 }
 
-void BoardHandler::servos_absolute_handler(const std::shared_ptr<smov_board_msgs::msg::ServoArray> msg) {
+// Frames are taken as unique pointers, so an intra-process publisher hands its message over without any copy.
+void BoardHandler::servos_absolute_handler(smov_board_msgs::msg::ServoArray::UniquePtr msg) {
+  auto start = std::chrono::steady_clock::now();
+
   for (auto &sp : msg->servos) {
     int servo = sp.servo;
     int value = sp.value;
@@ -109,26 +152,71 @@ void BoardHandler::servos_absolute_handler(const std::shared_ptr<smov_board_msgs
                    value);
       continue;
     }
-    this->board_node->set_pwm_interval(servo, 0, value);
+    this->board_node->stage_pwm_interval(servo, 0, value);
     RCLCPP_DEBUG(rclcpp::get_logger("rclcpp"), "servo[%d] = %d", servo, value);
   }
+  this->board_node->write_pwm_frame();
+
+  this->board_node->metrics.callback_time_us.record(static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count()));
 }
 
-void BoardHandler::servos_proportional_handler(const std::shared_ptr<smov_board_msgs::msg::ServoArray> msg) {
-  for (auto &sp : msg->servos) {
-    int servo = sp.servo;
-    float value = sp.value;
-    this->board_node->set_pwm_interval_proportional(servo, value);
+void BoardHandler::servos_proportional_handler(smov_board_msgs::msg::ServoArray::UniquePtr msg) {
+  auto start = std::chrono::steady_clock::now();
+
+  // The scratch arrays keep their capacity, so steady state callbacks do not allocate.
+  this->batch_servos.resize(msg->servos.size());
+  this->batch_values.resize(msg->servos.size());
+  for (size_t i = 0; i < msg->servos.size(); i++) {
+    this->batch_servos[i] = msg->servos[i].servo;
+    this->batch_values[i] = msg->servos[i].value;
   }
+  this->board_node->stage_pwm_intervals_proportional(this->batch_servos.data(),
+                                                     this->batch_values.data(),
+                                                     static_cast<int>(this->batch_servos.size()));
+
+  // The whole frame hits the bus in one burst.
+  this->board_node->write_pwm_frame();
+
+  this->board_node->metrics.callback_time_us.record(static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count()));
 }
 
-void BoardHandler::servos_drive_handler(const std::shared_ptr<geometry_msgs::msg::Twist> msg) {
-  int i;
-  float delta, range, ratio;
-  float temp_x, temp_y, temp_r;
-  float dir_x, dir_y, dir_r;
-  float speed[4];
+// The fixed size frame is unpacked on the stack, so this path does not allocate.
+void BoardHandler::servos_frame_handler(smov_board_msgs::msg::ServoFrame::UniquePtr msg) {
+  auto start = std::chrono::steady_clock::now();
+
+  // A sequence of 0 is not tracked, other frames older than the last one taken are dropped. A sequence of 1 starts
+  // over, as the publisher restarted.
+  if (msg->sequence != 0) {
+    if ((msg->sequence != 1) && (this->last_frame_sequence != 0)
+        && (static_cast<int32_t>(msg->sequence - this->last_frame_sequence) <= 0)) {
+      RCLCPP_DEBUG(rclcpp::get_logger("rclcpp"), "Dropping stale frame %u", msg->sequence);
+      this->board_node->metrics.frames_stale++;
+      return;
+    }
+    this->last_frame_sequence = msg->sequence;
+  }
+
+  int servos[16];
+  float values[16];
+  int count = 0;
+  for (int channel = 0; channel < 16; channel++) {
+    if ((msg->mask & (1u << channel)) == 0)
+      continue;
+    servos[count] = msg->first_servo + channel;
+    values[count] = msg->value[channel];
+    count++;
+  }
+
+  this->board_node->stage_pwm_intervals_proportional(servos, values, count);
+  this->board_node->write_pwm_frame();
+
+  this->board_node->metrics.callback_time_us.record(static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count()));
+}
 
+void BoardHandler::servos_drive_handler(const std::shared_ptr<geometry_msgs::msg::Twist> msg) {
   /* "msg" is a pointer to a Twist message: msg->linear and msg->angular each of which have members .x .y .z .*/
   /* the subscriber uses the maths from: http://robotsforroboticists.com/drive-kinematics/ . */
 
@@ -147,159 +235,56 @@ void BoardHandler::servos_drive_handler(const std::shared_ptr<geometry_msgs::msg
     return;
   }
 
-  dir_x = static_cast<float>(((msg->linear.x < 0) ? -1 : 1));
-  dir_y = static_cast<float>(((msg->linear.y < 0) ? -1 : 1));
-  dir_r = static_cast<float>(((msg->angular.z < 0) ? -1 : 1));
-
-  temp_x = static_cast<float>(this->board_node->get_active_drive().scale * std::abs(msg->linear.x));
-  temp_y = static_cast<float>(this->board_node->get_active_drive().scale * std::abs(msg->linear.y));
-  temp_r = static_cast<float>(std::abs(msg->angular.z));    // Radians.
-
-  // The differential rate is the robot rotational circumference / angular velocity.
-  // Since the differential rate is applied to both sides in opposite amounts it is halved.
-  delta = (this->board_node->get_active_drive().track / 2) * temp_r;
-  // Delta is now in meters/sec.
-
-  // Determine if we will over-speed the motor and scale accordingly.
-  ratio = this->board_node->convert_mps_to_proportional(temp_x + delta);
-  if (ratio > 1.0)
-    temp_x /= ratio;
-
-  switch (this->board_node->get_active_drive().mode) {
-    case smov::MODE_ACKERMAN:
-      /*
-        With ackerman drive, steering is handled by a separate servo.
-        We drive assigned servos exclusively by the linear.x.
-      */
-      speed[0] = temp_x * dir_x;
-      speed[0] = this->board_node->convert_mps_to_proportional(speed[0]);
-      if (std::abs(speed[0]) > 1.0)
-        speed[0] = static_cast<float>(1.0 * dir_x);
-
-      RCLCPP_DEBUG(rclcpp::get_logger("rclcpp"), "ackerman drive mode speed=%6.4f", speed[0]);
-      break;
-    case smov::MODE_DIFFERENTIAL:
-      /*
-        With differential drive, steering is handled by the relative speed of left and right servos.
-        We drive assigned servos by mixing linear.x and angular.z.
-        We compute the delta for left and right components.
-        We use the sign of the angular velocity to determine which is the faster / slower.
-      */
-
-      /* The delta is the angular velocity * half the drive track. */
-
-      if (dir_r > 0) {    // Turning right.
-        speed[0] = (temp_x + delta) * dir_x;
-        speed[1] = (temp_x - delta) * dir_x;
-      } else {        // Turning left.
-        speed[0] = (temp_x - delta) * dir_x;
-        speed[1] = (temp_x + delta) * dir_x;
-      }
-
-      RCLCPP_DEBUG(rclcpp::get_logger("rclcpp"),
-                   "computed differential drive mode speed left=%6.4f right=%6.4f",
-                   speed[0],
-                   speed[1]);
-
-      /* Ff any of the results are greater that 1.0, we need to scale all the results down. */
-      range = std::max(std::abs(speed[0]), std::abs(speed[1]));
+  // Only the latest command is kept, it is applied on the next drive tick.
+  this->drive_target[0] = static_cast<float>(msg->linear.x);
+  this->drive_target[1] = static_cast<float>(msg->linear.y);
+  this->drive_target[2] = static_cast<float>(msg->angular.z);
+  this->drive_pending = true;
+}
 
-      ratio = this->board_node->convert_mps_to_proportional(range);
-      if (ratio > 1.0) {
-        speed[0] /= ratio;
-        speed[1] /= ratio;
-      }
-      RCLCPP_DEBUG(rclcpp::get_logger("rclcpp"),
-                   "adjusted differential drive mode speed left=%6.4f right=%6.4f",
-                   speed[0],
-                   speed[1]);
-
-      speed[0] = this->board_node->convert_mps_to_proportional(speed[0]);
-      speed[1] = this->board_node->convert_mps_to_proportional(speed[1]);
-
-      RCLCPP_DEBUG(rclcpp::get_logger("rclcpp"),
-                   "differential drive mode speed left=%6.4f right=%6.4f",
-                   speed[0],
-                   speed[1]);
-      break;
-    case smov::MODE_MECANUM:
-      /*
-        With mecanum drive, steering is handled by the relative speed of left and right servos.
-        With mecanum drive, lateral motion is handled by the rotation of front and rear servos.
-        We drive assigned servos by mixing linear.x and angular.z  and linear.y.
-      */
-
-      if (dir_r > 0) {    // Turning right.
-        speed[0] = speed[2] = (temp_x + delta) * dir_x;
-        speed[1] = speed[3] = (temp_x - delta) * dir_x;
-      } else {        // Turning left.
-        speed[0] = speed[2] = (temp_x - delta) * dir_x;
-        speed[1] = speed[3] = (temp_x + delta) * dir_x;
-      }
+/**
+ * \private Method to move the drive servos towards the latest command, called once per PWM period.
+ *
+ * Each speed changes by at most its acceleration limit times the time since the last tick, until the command is
+ * reached. The drive servos were indexed when configured, their speeds are mixed together and written as one frame.
+ */
+void BoardHandler::drive_tick_handler() {
+  auto now = std::chrono::steady_clock::now();
+  double elapsed = std::chrono::duration<double>(now - this->drive_tick).count();
+  this->drive_tick = now;
+
+  if (!this->drive_pending)
+    return;
 
-      speed[0] += temp_y * dir_y;
-      speed[3] += temp_y * dir_y;
-      speed[1] -= temp_y * dir_y;
-      speed[2] -= temp_y * dir_y;
-      RCLCPP_DEBUG(rclcpp::get_logger("rclcpp"),
-                   "computed mecanum drive mode speed leftfront=%6.4f rightfront=%6.4f leftrear=%6.4f rightreer=%6.4f",
-                   speed[0],
-                   speed[1],
-                   speed[2],
-                   speed[3]);
-
-      range =
-          std::max(std::max(std::max(std::abs(speed[0]), std::abs(speed[1])), std::abs(speed[2])), std::abs(speed[3]));
-      ratio = this->board_node->convert_mps_to_proportional(range);
-      if (ratio > 1.0) {
-        speed[0] /= ratio;
-        speed[1] /= ratio;
-        speed[2] /= ratio;
-        speed[3] /= ratio;
+  const double limits[3] = {this->drive_linear_accel, this->drive_linear_accel, this->drive_angular_accel};
+  bool reached = true;
+  for (int i = 0; i < 3; i++) {
+    float step = this->drive_target[i] - this->drive_current[i];
+    if (limits[i] > 0.0) {
+      auto max_step = static_cast<float>(limits[i] * elapsed);
+      if (std::abs(step) > max_step) {
+        step = (step < 0) ? -max_step : max_step;
+        reached = false;
       }
-      RCLCPP_DEBUG(rclcpp::get_logger("rclcpp"),
-                   "adjusted mecanum drive mode speed leftfront=%6.4f rightfront=%6.4f leftrear=%6.4f rightreer=%6.4f",
-                   speed[0],
-                   speed[1],
-                   speed[2],
-                   speed[3]);
-
-      speed[0] = this->board_node->convert_mps_to_proportional(speed[0]);
-      speed[1] = this->board_node->convert_mps_to_proportional(speed[1]);
-      speed[2] = this->board_node->convert_mps_to_proportional(speed[2]);
-      speed[3] = this->board_node->convert_mps_to_proportional(speed[3]);
-
-      RCLCPP_DEBUG(rclcpp::get_logger("rclcpp"),
-                   "mecanum drive mode speed leftfront=%6.4f rightfront=%6.4f leftrear=%6.4f rightreer=%6.4f",
-                   speed[0],
-                   speed[1],
-                   speed[2],
-                   speed[3]);
-      break;
-    default:break;
-  }
-
-  /* Find all drive servos and set their new speed. */
-  for (i = 0; i < (this->board_node->get_last_servo()); i++) {
-    // We use 'fall through' on the switch statement to allow all necessary servos to be controlled.
-    switch (this->board_node->get_active_drive().mode) {
-      case smov::MODE_MECANUM:
-        if (this->board_node->servo_configs[i].mode_pos == smov::POSITION_RIGHTREAR)
-          this->board_node->set_pwm_interval_proportional(i + 1, speed[3]);
-        if (this->board_node->servo_configs[i].mode_pos == smov::POSITION_LEFTREAR)
-          this->board_node->set_pwm_interval_proportional(i + 1, speed[2]);
-        break; // This may cause an issue.   ^
-        //                            |
-      case smov::MODE_DIFFERENTIAL:
-        if (this->board_node->servo_configs[i].mode_pos == smov::POSITION_RIGHTFRONT)
-          this->board_node->set_pwm_interval_proportional(i + 1, speed[1]);
-        break; // This may cause an issue.
-      case smov::MODE_ACKERMAN:
-        if (this->board_node->servo_configs[i].mode_pos == smov::POSITION_LEFTFRONT)
-          this->board_node->set_pwm_interval_proportional(i + 1, speed[0]);
-        break; // This may cause an issue.
     }
+    this->drive_current[i] += step;
   }
+  this->drive_pending = !reached;
+
+  smov::DriveMixer &mixer = this->board_node->drive_mixer;
+  int count = mixer.mix(this->drive_current[0], this->drive_current[1], this->drive_current[2]);
+
+  const float *speed = mixer.get_wheel_speeds();
+  RCLCPP_DEBUG(rclcpp::get_logger("rclcpp"),
+               "drive mode %d speed leftfront=%6.4f rightfront=%6.4f leftrear=%6.4f rightrear=%6.4f",
+               this->board_node->get_active_drive().mode,
+               speed[0],
+               speed[1],
+               speed[2],
+               speed[3]);
+
+  this->board_node->stage_pwm_intervals_proportional(mixer.get_servos(), mixer.get_values(), count);
+  this->board_node->write_pwm_frame();
 }
 
 bool BoardHandler::set_pwm_frequency_handler(const std::shared_ptr<smov_board_msgs::srv::IntValue::Request> req,
@@ -315,6 +300,8 @@ bool BoardHandler::set_pwm_frequency_handler(const std::shared_ptr<smov_board_ms
   }
 
   this->board_node->set_pwm_frequency(freq);    // I think we must reset frequency when we change boards.
+  if (this->drive_timer)
+    this->start_drive_timer();
   res->error = static_cast<int16_t>(freq);
   return true;
 }
@@ -333,15 +320,15 @@ bool BoardHandler::config_servos_handler(const std::shared_ptr<smov_board_msgs::
     return true;
   }
 
+  // The whole request is applied at once, only the servos whose calibration changed are updated.
+  std::vector<smov::ServoCalibration> calibrations(req->servos.size());
   for (i = 0; i < req->servos.size(); i++) {
-    int servo = req->servos[i].servo;
-    int center = req->servos[i].center;
-    int range = req->servos[i].range;
-    int direction = req->servos[i].direction;
-
-    this->board_node->config_servo(servo, center, range, direction);
-
+    calibrations[i].servo = req->servos[i].servo;
+    calibrations[i].center = req->servos[i].center;
+    calibrations[i].range = req->servos[i].range;
+    calibrations[i].direction = req->servos[i].direction;
   }
+  this->board_node->config_servos(calibrations);
 
   return true;
 }
@@ -377,8 +364,21 @@ bool BoardHandler::stop_servos_handler(const std::shared_ptr<std_srvs::srv::Empt
   int save_active = this->board_node->get_active_board();
   int i = 0;
 
+  // A drive command still ramping must not power the drive servos again once stopped.
+  for (int axis = 0; axis < 3; axis++)
+    this->drive_target[axis] = this->drive_current[axis] = 0.0f;
+  this->drive_pending = false;
+
+  // Frames that did not reach the bus yet must not power the servos again once stopped.
+  this->board_node->discard_pwm_frames();
+
+  // One broadcast stops every board, the boards it did not reach are addressed one by one.
+  uint64_t missed = this->board_node->set_pwm_interval_broadcast(0, 0);
+  if (missed == 0)
+    return true;
+
   for (i = 0; i < MAX_BOARDS; i++) {
-    if (this->board_node->pwm_boards[i] > 0) {
+    if (missed & (1ull << i)) {
       this->board_node->set_active_board(i + 1);    // API is ONE based.
       this->board_node->set_pwm_interval_all(0, 0);
     }
@@ -387,4 +387,43 @@ bool BoardHandler::stop_servos_handler(const std::shared_ptr<std_srvs::srv::Empt
   return true;
 }
 
-}
\ No newline at end of file
+/**
+ * \private Method to publish the controller metrics as a diagnostic status.
+ *
+ * The level turns to WARN once a bus error was recorded.
+ */
+void BoardHandler::publish_diagnostics() {
+  diagnostic_msgs::msg::DiagnosticArray array;
+  diagnostic_msgs::msg::DiagnosticStatus status;
+
+  status.name = std::string(this->board_node->get_name()) + ": I2C bus";
+  status.hardware_id = "pca9685";
+  status.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+  status.message = "OK";
+
+  for (auto &value : this->board_node->metrics.get_values()) {
+    diagnostic_msgs::msg::KeyValue key_value;
+    key_value.key = value.first;
+    key_value.value = value.second;
+    status.values.push_back(key_value);
+
+    if (value.first.compare(0, 7, "errors_") == 0) {
+      status.level = diagnostic_msgs::msg::DiagnosticStatus::WARN;
+      status.message = "Bus errors";
+    }
+  }
+
+  array.header.stamp = this->board_node->now();
+  array.status.push_back(status);
+  this->diagnostics_pub->publish(array);
+}
+
+/**
+ * \private Method to log every metric, used when the controller shuts down.
+ */
+void BoardHandler::dump_metrics() const {
+  for (auto &value : this->board_node->metrics.get_values())
+    RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "%s: %s", value.first.c_str(), value.second.c_str());
+}
+
+}
@@ -0,0 +1,147 @@
+//
+// Created by ros on 2/3/24.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#include "board_metrics.h"
+
+namespace smov {
+
+Histogram::Histogram() : count(0), sum(0), max(0) {
+  for (auto &bucket : this->buckets)
+    bucket = 0;
+}
+
+void Histogram::record(uint64_t value) {
+  int bucket = value == 0 ? 0 : 64 - __builtin_clzll(value);
+  if (bucket >= BUCKETS)
+    bucket = BUCKETS - 1;
+
+  this->buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  this->count.fetch_add(1, std::memory_order_relaxed);
+  this->sum.fetch_add(value, std::memory_order_relaxed);
+
+  uint64_t previous = this->max.load(std::memory_order_relaxed);
+  while (previous < value && !this->max.compare_exchange_weak(previous, value, std::memory_order_relaxed)) {}
+}
+
+uint64_t Histogram::get_count() const {
+  return this->count.load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::get_max() const {
+  return this->max.load(std::memory_order_relaxed);
+}
+
+double Histogram::get_mean() const {
+  uint64_t samples = this->get_count();
+  if (samples == 0)
+    return 0.0;
+  return static_cast<double>(this->sum.load(std::memory_order_relaxed)) / static_cast<double>(samples);
+}
+
+/**
+ * Method to get the upper bound of the bucket holding a percentile.
+ *
+ * @param percentile a double value (0..100).
+ * @returns The upper bound of the bucket, capped by the largest recorded value.
+ */
+uint64_t Histogram::get_percentile(double percentile) const {
+  uint64_t samples = this->get_count();
+  if (samples == 0)
+    return 0;
+
+  auto rank = static_cast<uint64_t>(std::ceil(static_cast<double>(samples) * percentile / 100.0));
+  uint64_t seen = 0;
+  for (int bucket = 0; bucket < BUCKETS; bucket++) {
+    seen += this->buckets[bucket].load(std::memory_order_relaxed);
+    if (seen >= rank && seen > 0) {
+      uint64_t bound = bucket == 0 ? 0 : (1ull << bucket) - 1;
+      return std::min(bound, this->get_max());
+    }
+  }
+  return this->get_max();
+}
+
+std::string Histogram::to_string() const {
+  char text[128];
+  snprintf(text, sizeof(text), "n=%llu mean=%.1f p50<=%llu p99<=%llu max=%llu",
+           static_cast<unsigned long long>(this->get_count()),
+           this->get_mean(),
+           static_cast<unsigned long long>(this->get_percentile(50.0)),
+           static_cast<unsigned long long>(this->get_percentile(99.0)),
+           static_cast<unsigned long long>(this->get_max()));
+  return text;
+}
+
+BoardMetrics::BoardMetrics()
+    : writes_issued(0), writes_skipped(0), frames_replaced(0), frames_stale(0), boards_verified(0), boards_reset(0),
+      channels_repaired(0) {
+  for (auto &errors : this->board_errors)
+    errors = 0;
+  for (auto &errors : this->channel_errors)
+    errors = 0;
+}
+
+/**
+ * Method to count a failed transaction on a board.
+ *
+ * @param board an int value (1..62).
+ */
+void BoardMetrics::record_board_error(int board) {
+  if ((board >= 1) && (board <= METRICS_MAX_BOARDS))
+    this->board_errors[board - 1].fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * Method to count a failed write of consecutive channels, on the board and on each channel.
+ *
+ * @param board an int value (1..62).
+ * @param channel an int value (0..15) indicating the first hardware channel.
+ * @param count an int value indicating the number of channels.
+ */
+void BoardMetrics::record_channel_errors(int board, int channel, int count) {
+  if ((board < 1) || (board > METRICS_MAX_BOARDS))
+    return;
+
+  this->record_board_error(board);
+  for (int i = channel; (i < channel + count) && (i < 16); i++)
+    this->channel_errors[(board - 1) * 16 + i].fetch_add(1, std::memory_order_relaxed);
+}
+
+std::vector<std::pair<std::string, std::string>> BoardMetrics::get_values() const {
+  std::vector<std::pair<std::string, std::string>> values;
+
+  values.emplace_back("frame_latency_us", this->frame_latency_us.to_string());
+  values.emplace_back("callback_time_us", this->callback_time_us.to_string());
+  values.emplace_back("frame_bytes", this->frame_bytes.to_string());
+  values.emplace_back("frame_transactions", this->frame_transactions.to_string());
+  values.emplace_back("writes_issued", std::to_string(this->writes_issued.load()));
+  values.emplace_back("writes_skipped", std::to_string(this->writes_skipped.load()));
+  values.emplace_back("frames_replaced", std::to_string(this->frames_replaced.load()));
+  values.emplace_back("frames_stale", std::to_string(this->frames_stale.load()));
+  values.emplace_back("boards_verified", std::to_string(this->boards_verified.load()));
+  values.emplace_back("boards_reset", std::to_string(this->boards_reset.load()));
+  values.emplace_back("channels_repaired", std::to_string(this->channels_repaired.load()));
+
+  // Only the boards and channels that failed at least once are listed.
+  for (int board = 0; board < METRICS_MAX_BOARDS; board++) {
+    uint64_t errors = this->board_errors[board].load(std::memory_order_relaxed);
+    if (errors == 0)
+      continue;
+
+    values.emplace_back("errors_board_" + std::to_string(board + 1), std::to_string(errors));
+    for (int channel = 0; channel < 16; channel++) {
+      uint64_t channel_errors = this->channel_errors[board * 16 + channel].load(std::memory_order_relaxed);
+      if (channel_errors != 0)
+        values.emplace_back("errors_servo_" + std::to_string(board * 16 + channel + 1), std::to_string(channel_errors));
+    }
+  }
+
+  return values;
+}
+
+}
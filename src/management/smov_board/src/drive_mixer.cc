@@ -0,0 +1,141 @@
+//
+// Created by ros on 2/3/24.
+//
+
+#include <algorithm>
+#include <cmath>
+
+#include "board_controller.h"
+#include "drive_mixer.h"
+
+namespace smov {
+
+DriveMixer::DriveMixer() : mode(smov::MODE_UNDEFINED), half_track(0.0f), scale(0.0f), max_rate(0.0f) {}
+
+/**
+ * Method to set the mixing matrix of a drive mode.
+ *
+ * Ackerman drives every assigned servo by linear.x alone, steering is left to a separate servo. Differential mixes
+ * linear.x with angular.z, the left wheels going faster when turning right. Mecanum also moves sideways with linear.y
+ * by turning the front and rear wheels of each side in opposite directions.
+ * @param mode an int value, one of drive_modes.
+ * @param rpm the motor's output RPM, greater than 0.
+ * @param radius the wheel radius in meters, greater than 0.
+ * @param track the axel track in meters, greater than 0.
+ * @param scale the scalar applied to the linear velocities of Twist messages, greater than 0.
+ */
+void DriveMixer::configure(int mode, float rpm, float radius, float track, float scale) {
+  static const float MATRICES[smov::MODE_INVALID][3][WHEELS] = {
+      {{0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}},       // Undefined.
+      {{1, 1, 1, 1}, {0, 0, 0, 0}, {0, 0, 0, 0}},       // Ackerman.
+      {{1, 1, 1, 1}, {0, 0, 0, 0}, {1, -1, 1, -1}},     // Differential.
+      {{1, 1, 1, 1}, {1, -1, -1, 1}, {1, -1, 1, -1}},   // Mecanum.
+  };
+
+  this->mode = ((mode > smov::MODE_UNDEFINED) && (mode < smov::MODE_INVALID)) ? mode : smov::MODE_UNDEFINED;
+  this->half_track = track / 2;
+  this->scale = scale;
+  this->max_rate = static_cast<float>((radius * M_PI * 2) * (rpm / 60.0));
+
+  for (int wheel = 0; wheel < WHEELS; wheel++) {
+    this->mix_x[wheel] = MATRICES[this->mode][0][wheel];
+    this->mix_y[wheel] = MATRICES[this->mode][1][wheel];
+    this->mix_r[wheel] = MATRICES[this->mode][2][wheel];
+  }
+
+  this->update_index();
+}
+
+/**
+ * Method to assign a servo to a wheel position, or to take it off the drive.
+ *
+ * @param servo an int value (1..992).
+ * @param position an int value, one of drive_mode_positions, POSITION_UNDEFINED for a non-drive servo.
+ */
+void DriveMixer::set_position(int servo, int position) {
+  for (auto &list : this->position_servos)
+    list.erase(std::remove(list.begin(), list.end(), servo), list.end());
+
+  if ((position > smov::POSITION_UNDEFINED) && (position < smov::POSITION_INVALID))
+    this->position_servos[position - 1].push_back(servo);
+
+  this->update_index();
+}
+
+void DriveMixer::clear() {
+  for (auto &list : this->position_servos)
+    list.clear();
+  this->configure(smov::MODE_UNDEFINED, 0.0f, 0.0f, 0.0f, 0.0f);
+}
+
+/**
+ * Method to compute the proportional speed of every drive servo.
+ *
+ * When the outer wheel would exceed full throttle, linear.x is reduced first. If a wheel still exceeds it, every
+ * wheel is scaled down by the same ratio so the motion keeps its direction. When reversing, turning is mirrored.
+ * @param linear_x the forward velocity in meters per second, before the drive scale.
+ * @param linear_y the sideways velocity in meters per second, before the drive scale.
+ * @param angular_z the rotation velocity in radians per second.
+ * @returns The number of drive servos, see get_servos() and get_values().
+ */
+int DriveMixer::mix(float linear_x, float linear_y, float angular_z) {
+  if (this->mode == smov::MODE_UNDEFINED)
+    return 0;
+
+  float x = this->scale * linear_x;
+  float y = this->scale * linear_y;
+  float r = ((linear_x < 0) ? -1.0f : 1.0f) * this->half_track * angular_z;
+
+  float outer = std::abs(x) + std::abs(r);
+  if (outer > this->max_rate)
+    x *= this->max_rate / outer;
+
+  float range = 0.0f;
+  for (int wheel = 0; wheel < WHEELS; wheel++) {
+    this->wheel_speeds[wheel] = this->mix_x[wheel] * x + this->mix_y[wheel] * y + this->mix_r[wheel] * r;
+    range = std::max(range, std::abs(this->wheel_speeds[wheel]));
+  }
+
+  float inverse = 1.0f / std::max(range, this->max_rate);
+  for (float &speed : this->wheel_speeds)
+    speed *= inverse;
+
+  size_t count = this->servos.size();
+  for (size_t i = 0; i < count; i++)
+    this->values[i] = this->wheel_speeds[this->wheels[i]];
+
+  return static_cast<int>(count);
+}
+
+const int *DriveMixer::get_servos() const {
+  return this->servos.data();
+}
+
+const float *DriveMixer::get_values() const {
+  return this->values.data();
+}
+
+const float *DriveMixer::get_wheel_speeds() const {
+  return this->wheel_speeds;
+}
+
+/**
+ * \private Method to list the servos the drive mode moves, with the wheel position each one follows.
+ */
+void DriveMixer::update_index() {
+  this->servos.clear();
+  this->wheels.clear();
+
+  for (int wheel = 0; wheel < WHEELS; wheel++) {
+    if ((this->mix_x[wheel] == 0.0f) && (this->mix_y[wheel] == 0.0f) && (this->mix_r[wheel] == 0.0f))
+      continue;
+    for (int servo : this->position_servos[wheel]) {
+      this->servos.push_back(servo);
+      this->wheels.push_back(wheel);
+    }
+  }
+
+  this->values.assign(this->servos.size(), 0.0f);
+}
+
+} // namespace smov
@@ -0,0 +1,34 @@
+//
+// Created by ros on 2/3/24.
+//
+
+#include "frame_mailbox.h"
+
+namespace smov {
+
+FrameMailbox::FrameMailbox() : back(0), front(1), middle(2) {}
+
+PwmFrame &FrameMailbox::get_back() {
+  return this->frames[this->back];
+}
+
+/**
+ * Swaps the back frame with the middle one, making it available to the consumer.
+ *
+ * @returns False if the previous frame was never taken and got dropped.
+ */
+bool FrameMailbox::publish() {
+  uint8_t previous = this->middle.exchange(static_cast<uint8_t>(this->back | FRESH), std::memory_order_acq_rel);
+  this->back = previous & INDEX;
+  return (previous & FRESH) == 0;
+}
+
+const PwmFrame *FrameMailbox::take() {
+  if ((this->middle.load(std::memory_order_acquire) & FRESH) == 0)
+    return nullptr;
+
+  this->front = this->middle.exchange(this->front, std::memory_order_acq_rel) & INDEX;
+  return &this->frames[this->front];
+}
+
+}
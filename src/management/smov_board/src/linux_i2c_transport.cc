@@ -0,0 +1,158 @@
+//
+// Created by ros on 2/3/24.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+extern "C" {
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <i2c/smbus.h>
+}
+
+#include <rclcpp/logging.hpp>
+
+#include "i2c_transport.h"
+
+namespace smov {
+
+LinuxI2cTransport::LinuxI2cTransport(const std::string &device)
+    : device(device), bus_handle(-1), use_block_transfer(false) {}
+
+LinuxI2cTransport::~LinuxI2cTransport() {
+  for (auto &handle : this->handles) {
+    if (handle.second >= 0)
+      close(handle.second);
+  }
+  if (this->bus_handle >= 0)
+    close(this->bus_handle);
+}
+
+bool LinuxI2cTransport::open_bus() {
+  if ((this->bus_handle = open(this->device.c_str(), O_RDWR)) < 0) {
+    RCLCPP_FATAL(rclcpp::get_logger("rclcpp"), "Failed to open I2C bus %s", this->device.c_str());
+    return false;
+  }
+
+  // Block writes go through I2C_RDWR when the adapter allows it, otherwise through SMBus block writes.
+  unsigned long funcs = 0;
+  this->use_block_transfer = (0 <= ioctl(this->bus_handle, I2C_FUNCS, &funcs)) && (funcs & I2C_FUNC_I2C);
+
+  RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "I2C bus opened on %s", this->device.c_str());
+  return true;
+}
+
+/**
+ * \private Method to get the handle bound to an address, opening and binding it the first time.
+ *
+ * @param address The 7 bit address of the device.
+ * @returns The file descriptor, or -1 if the device cannot be reached.
+ */
+int LinuxI2cTransport::get_handle(int address) {
+  auto found = this->handles.find(address);
+  if (found != this->handles.end())
+    return found->second;
+
+  // Remember failures too, so a missing device does not cost an open() on every transaction.
+  int handle = open(this->device.c_str(), O_RDWR);
+  if (handle < 0) {
+    RCLCPP_FATAL(rclcpp::get_logger("rclcpp"), "Failed to open I2C bus %s", this->device.c_str());
+  } else if (0 > ioctl(handle, I2C_SLAVE, address)) {
+    RCLCPP_FATAL(rclcpp::get_logger("rclcpp"),
+                 "Failed to acquire bus access and/or talk to I2C slave at address 0x%02X",
+                 address);
+    close(handle);
+    handle = -1;
+  }
+
+  this->handles[address] = handle;
+  return handle;
+}
+
+bool LinuxI2cTransport::write(int address, uint8_t reg, const uint8_t *data, size_t length) {
+  int handle = this->get_handle(address);
+  if (handle < 0)
+    return false;
+
+  if (length == 1)
+    return 0 <= i2c_smbus_write_byte_data(handle, reg, data[0]);
+
+  if (this->use_block_transfer) {
+    uint8_t buffer[1 + 255];
+    if (length > sizeof(buffer) - 1)
+      return false;
+
+    buffer[0] = reg;
+    memcpy(&buffer[1], data, length);
+
+    struct i2c_msg message = {};
+    message.addr = static_cast<uint16_t>(address);
+    message.flags = 0;
+    message.len = static_cast<uint16_t>(1 + length);
+    message.buf = buffer;
+
+    struct i2c_rdwr_ioctl_data transfer = {&message, 1};
+    return 0 <= ioctl(handle, I2C_RDWR, &transfer);
+  }
+
+  // SMBus only adapters are limited to 32 byte blocks, which is 8 channels per transaction.
+  for (size_t i = 0; i < length; i += I2C_SMBUS_BLOCK_MAX) {
+    size_t chunk = std::min(length - i, static_cast<size_t>(I2C_SMBUS_BLOCK_MAX));
+    if (0 > i2c_smbus_write_i2c_block_data(handle,
+                                           static_cast<uint8_t>(reg + i),
+                                           static_cast<uint8_t>(chunk),
+                                           &data[i]))
+      return false;
+  }
+  return true;
+}
+
+bool LinuxI2cTransport::read(int address, uint8_t reg, uint8_t *data, size_t length) {
+  int handle = this->get_handle(address);
+  if (handle < 0)
+    return false;
+
+  if (length == 1) {
+    int value = i2c_smbus_read_byte_data(handle, reg);
+    if (value < 0)
+      return false;
+    data[0] = static_cast<uint8_t>(value);
+    return true;
+  }
+
+  if (this->use_block_transfer) {
+    // Register address write followed by a repeated start read, in a single transaction.
+    struct i2c_msg messages[2] = {};
+    messages[0].addr = static_cast<uint16_t>(address);
+    messages[0].flags = 0;
+    messages[0].len = 1;
+    messages[0].buf = &reg;
+    messages[1].addr = static_cast<uint16_t>(address);
+    messages[1].flags = I2C_M_RD;
+    messages[1].len = static_cast<uint16_t>(length);
+    messages[1].buf = data;
+
+    struct i2c_rdwr_ioctl_data transfer = {messages, 2};
+    return 0 <= ioctl(handle, I2C_RDWR, &transfer);
+  }
+
+  for (size_t i = 0; i < length; i += I2C_SMBUS_BLOCK_MAX) {
+    size_t chunk = std::min(length - i, static_cast<size_t>(I2C_SMBUS_BLOCK_MAX));
+    if (static_cast<int>(chunk) != i2c_smbus_read_i2c_block_data(handle,
+                                                                 static_cast<uint8_t>(reg + i),
+                                                                 static_cast<uint8_t>(chunk),
+                                                                 &data[i]))
+      return false;
+  }
+  return true;
+}
+
+std::string LinuxI2cTransport::get_name() const {
+  return this->device;
+}
+
+}
@@ -0,0 +1,89 @@
+//
+// Created by ros on 2/3/24.
+//
+
+#include <algorithm>
+
+#include "servo_table.h"
+
+namespace smov {
+
+ServoTable::ServoTable() {
+  this->clear();
+}
+
+int ServoTable::find(int servo) const {
+  if ((servo < 1) || (servo > TABLE_MAX_SERVOS))
+    return -1;
+  return this->slots[servo - 1];
+}
+
+int ServoTable::insert(int servo) {
+  int slot = this->find(servo);
+  if ((slot >= 0) || (servo < 1) || (servo > TABLE_MAX_SERVOS))
+    return slot;
+
+  slot = this->size();
+  this->slots[servo - 1] = static_cast<int16_t>(slot);
+  this->servo.push_back(servo);
+  this->center.push_back(-1);
+  this->range.push_back(-1);
+  this->direction.push_back(1);
+  this->mode_pos.push_back(-1);
+  this->scale.push_back(0.0f);
+  this->offset.push_back(0.0f);
+  this->low.push_back(0.0f);
+  this->high.push_back(0.0f);
+  return slot;
+}
+
+void ServoTable::clear() {
+  for (auto &slot : this->slots)
+    slot = -1;
+
+  this->servo.clear();
+  this->center.clear();
+  this->range.clear();
+  this->direction.clear();
+  this->mode_pos.clear();
+  this->scale.clear();
+  this->offset.clear();
+  this->low.clear();
+  this->high.clear();
+}
+
+int ServoTable::size() const {
+  return static_cast<int>(this->servo.size());
+}
+
+/**
+ * Method to set the calibration of a servo.
+ *
+ * The count is direction * (range / 2) * value + center, clamped to the servo travel within 0..4095.
+ * @param servo An int value (1..992).
+ * @param center An int value, the count of the neutral position.
+ * @param range An int value, the count between both ends of the travel.
+ * @param direction An int either -1 or 1.
+ * @returns False if the servo already had this calibration, or if the servo number is invalid.
+ */
+bool ServoTable::configure(int servo, int center, int range, int direction) {
+  int slot = this->insert(servo);
+  if (slot < 0)
+    return false;
+  if ((this->center[slot] == center) && (this->range[slot] == range) && (this->direction[slot] == direction))
+    return false;
+
+  float half = static_cast<float>(range) / 2;
+  auto neutral = static_cast<float>(center);
+
+  this->center[slot] = center;
+  this->range[slot] = range;
+  this->direction[slot] = direction;
+  this->scale[slot] = static_cast<float>(direction) * half;
+  this->offset[slot] = neutral;
+  this->low[slot] = std::max(0.0f, neutral - half);
+  this->high[slot] = std::min(4095.0f, neutral + half);
+  return true;
+}
+
+} // namespace smov
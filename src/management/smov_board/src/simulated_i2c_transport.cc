@@ -0,0 +1,129 @@
+//
+// Created by ros on 2/3/24.
+//
+
+#include <algorithm>
+#include <ctime>
+
+#include "i2c_transport.h"
+#include "pca9685.h"
+
+namespace smov {
+
+SimulatedI2cTransport::SimulatedI2cTransport(int bus_speed, bool realtime)
+    : bus_speed(bus_speed), realtime(realtime), transactions(0), bytes(0), bus_time_ns(0) {}
+
+SimulatedI2cTransport::~SimulatedI2cTransport() = default;
+
+bool SimulatedI2cTransport::open_bus() {
+  return true;
+}
+
+/**
+ * \private Method to get the register file of a device, powering it up the first time.
+ *
+ * Devices come up like a PCA9685 after reset: asleep, with ALLCALL enabled and a 200Hz prescaler.
+ */
+SimulatedI2cTransport::RegisterFile &SimulatedI2cTransport::get_device(int address) {
+  auto found = this->devices.find(address);
+  if (found != this->devices.end())
+    return found->second;
+
+  RegisterFile &device = this->devices[address];
+  std::fill_n(device.regs, 256, 0);
+  device.regs[smov::MODE1] = smov::SLEEP | smov::ALLCALL;
+  device.regs[smov::MODE2] = smov::OUTDRV;
+  device.regs[smov::PRESCALE] = 0x1E;
+  return device;
+}
+
+/**
+ * \private Method to get the register the next byte of a transaction goes to.
+ *
+ * Without auto-increment every byte hits the same register, like on the real chip.
+ */
+uint8_t SimulatedI2cTransport::next_register(const RegisterFile &device, uint8_t reg) const {
+  if ((device.regs[smov::MODE1] & smov::AUTO_INCREMENT) == 0)
+    return reg;
+  return static_cast<uint8_t>(reg + 1);
+}
+
+/**
+ * \private Method to account for a transaction of the given number of bits, START and STOP included.
+ */
+void SimulatedI2cTransport::account(size_t bits) {
+  uint64_t duration = (static_cast<uint64_t>(bits) * 1000000000ull) / static_cast<uint64_t>(this->bus_speed);
+
+  this->transactions++;
+  this->bus_time_ns += duration;
+
+  if (this->realtime) {
+    const struct timespec wait = {static_cast<time_t>(duration / 1000000000ull),
+                                  static_cast<long>(duration % 1000000000ull)};
+    nanosleep(&wait, nullptr);
+  }
+}
+
+bool SimulatedI2cTransport::write(int address, uint8_t reg, const uint8_t *data, size_t length) {
+  // START, address byte, register byte and data bytes each with their ACK, then STOP.
+  this->account(2 + 9 * (2 + length));
+  this->bytes += 2 + length;
+
+  // Every device listening to the ALLCALL address takes the same transaction.
+  if (address == ALLCALL_ADDR) {
+    for (auto &device : this->devices)
+      if (device.second.regs[smov::MODE1] & smov::ALLCALL)
+        this->write_device(device.second, reg, data, length);
+    return true;
+  }
+
+  this->write_device(this->get_device(address), reg, data, length);
+  return true;
+}
+
+/**
+ * \private Method to store the data bytes of a write transaction in the registers of a device.
+ */
+void SimulatedI2cTransport::write_device(RegisterFile &device, uint8_t reg, const uint8_t *data, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    // The prescaler can only be written while the oscillator is asleep.
+    if (reg != smov::PRESCALE || (device.regs[smov::MODE1] & smov::SLEEP))
+      device.regs[reg] = data[i];
+    reg = this->next_register(device, reg);
+  }
+}
+
+bool SimulatedI2cTransport::read(int address, uint8_t reg, uint8_t *data, size_t length) {
+  // Register address write, then repeated START, address byte and data bytes, then STOP.
+  this->account(2 + 9 * 2 + 1 + 9 * (1 + length));
+  this->bytes += 3 + length;
+
+  RegisterFile &device = this->get_device(address);
+  for (size_t i = 0; i < length; i++) {
+    data[i] = device.regs[reg];
+    reg = this->next_register(device, reg);
+  }
+  return true;
+}
+
+std::string SimulatedI2cTransport::get_name() const {
+  return "simulated";
+}
+
+int SimulatedI2cTransport::get_bus_speed() const {
+  return this->bus_speed;
+}
+
+uint64_t SimulatedI2cTransport::get_transactions() const {
+  return this->transactions;
+}
+
+uint64_t SimulatedI2cTransport::get_bytes() const {
+  return this->bytes;
+}
+
+uint64_t SimulatedI2cTransport::get_bus_time_ns() const {
+  return this->bus_time_ns;
+}
+
+}
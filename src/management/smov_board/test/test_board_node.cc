@@ -0,0 +1,183 @@
+//
+// Created by ros on 2/3/24.
+//
+
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <rclcpp/rclcpp.hpp>
+
+#include "board_controller.h"
+
+namespace {
+
+// START and STOP, then the address, register and data bytes with their ACK.
+uint64_t write_time_ns(size_t length, int bus_speed) {
+  return (2 + 9 * (2 + length)) * 1000000000ull / static_cast<uint64_t>(bus_speed);
+}
+
+// Sum of the values recorded by a histogram.
+uint64_t get_total(const smov::Histogram &histogram) {
+  return static_cast<uint64_t>(histogram.get_mean() * static_cast<double>(histogram.get_count()) + 0.5);
+}
+
+}
+
+// A controller on a simulated bus, writing the frames from the test thread.
+class BoardNodeTest : public ::testing::Test {
+ protected:
+  static void SetUpTestCase() {
+    rclcpp::init(0, nullptr);
+  }
+
+  static void TearDownTestCase() {
+    rclcpp::shutdown();
+  }
+
+  static std::shared_ptr<smov::BoardNode> make_board(rclcpp::NodeOptions options) {
+    options.append_parameter_override("i2c_transport", std::string("simulated"))
+        .append_parameter_override("i2c_simulate_timing", false)
+        .append_parameter_override("writer_thread", false);
+    auto board = std::make_shared<smov::BoardNode>("test_board", "/", options);
+    board->init(1, 50);
+    return board;
+  }
+
+  // Stages the OFF counts of the first servos of board 1 and writes the frame.
+  static void write_frame(smov::BoardNode &board, const std::vector<int> &counts) {
+    for (size_t i = 0; i < counts.size(); i++)
+      board.stage_pwm_interval(static_cast<int>(i) + 1, 0, counts[i]);
+    board.write_pwm_frame();
+  }
+};
+
+TEST_F(BoardNodeTest, UnchangedChannelsAreSkipped) {
+  auto board = make_board(rclcpp::NodeOptions());
+  auto &metrics = board->metrics;
+
+  uint64_t issued = metrics.writes_issued;
+  write_frame(*board, {300, 310, 320, 330});
+  EXPECT_EQ(metrics.writes_issued - issued, 4u);
+
+  issued = metrics.writes_issued;
+  uint64_t skipped = metrics.writes_skipped;
+  write_frame(*board, {300, 310, 320, 330});
+  EXPECT_EQ(metrics.writes_issued - issued, 0u);
+  EXPECT_EQ(metrics.writes_skipped - skipped, 4u);
+}
+
+// The budget the driver is held to: a whole-body pose of 12 servos on one board reaches it in a single block write,
+// within a 50 Hz PWM period even on a 100 kHz bus.
+TEST_F(BoardNodeTest, WholeBodyFrameFitsInAPwmPeriod) {
+  const uint64_t period_ns = 1000000000ull / 50;
+  auto board = make_board(rclcpp::NodeOptions().append_parameter_override("i2c_bus_speed", 100000));
+  auto *bus = dynamic_cast<const smov::SimulatedI2cTransport *>(board->get_transport(1));
+  ASSERT_NE(bus, nullptr);
+  write_frame(*board, std::vector<int>(12, 300));
+
+  uint64_t transactions = bus->get_transactions();
+  uint64_t bus_time = bus->get_bus_time_ns();
+  write_frame(*board, std::vector<int>(12, 310));
+  EXPECT_EQ(bus->get_transactions() - transactions, 1u);
+  EXPECT_EQ(bus->get_bus_time_ns() - bus_time, write_time_ns(4 * 12, 100000));
+  EXPECT_LT(bus->get_bus_time_ns() - bus_time, period_ns);
+  EXPECT_EQ(board->metrics.frame_bytes.get_max(), 1u + 4 * 12);
+
+  // Changing the first and last servos only still costs a single transaction.
+  std::vector<int> counts(12, 310);
+  counts.front() = 320;
+  counts.back() = 320;
+  transactions = bus->get_transactions();
+  write_frame(*board, counts);
+  EXPECT_EQ(bus->get_transactions() - transactions, 1u);
+}
+
+TEST_F(BoardNodeTest, AtomicFrameRewritesTheCleanChannelsBetweenDirtyOnes) {
+  auto board = make_board(rclcpp::NodeOptions());
+  auto &metrics = board->metrics;
+  write_frame(*board, {300, 310, 320, 330});
+
+  uint64_t issued = metrics.writes_issued;
+  uint64_t transactions = get_total(metrics.frame_transactions);
+  write_frame(*board, {301, 310, 320, 331});
+  EXPECT_EQ(metrics.writes_issued - issued, 4u);
+  EXPECT_EQ(get_total(metrics.frame_transactions) - transactions, 1u);
+}
+
+TEST_F(BoardNodeTest, DirtyRunsSplitWithoutAtomicFrames) {
+  auto board = make_board(rclcpp::NodeOptions().append_parameter_override("pwm_atomic_frames", false));
+  auto &metrics = board->metrics;
+  write_frame(*board, {300, 310, 320, 330, 340});
+
+  uint64_t issued = metrics.writes_issued;
+  uint64_t skipped = metrics.writes_skipped;
+  uint64_t transactions = get_total(metrics.frame_transactions);
+  write_frame(*board, {301, 311, 320, 330, 341});
+  EXPECT_EQ(metrics.writes_issued - issued, 3u);
+  EXPECT_EQ(metrics.writes_skipped - skipped, 2u);
+  EXPECT_EQ(get_total(metrics.frame_transactions) - transactions, 2u);
+}
+
+TEST_F(BoardNodeTest, ControllerSettingsAreOnTheControllerNode) {
+  auto board = make_board(rclcpp::NodeOptions());
+  for (const char *name : {"pwm_stagger", "pwm_atomic_frames", "i2c_transport", "i2c_bus_boards", "writer_thread",
+                           "verify_period_ms"})
+    EXPECT_TRUE(board->has_parameter(name)) << name;
+}
+
+TEST_F(BoardNodeTest, StopIsOneBroadcastByDefault) {
+  auto board = make_board(rclcpp::NodeOptions());
+  auto *bus = dynamic_cast<const smov::SimulatedI2cTransport *>(board->get_transport(1));
+  ASSERT_NE(bus, nullptr);
+  write_frame(*board, std::vector<int>(16, 300));
+
+  uint64_t transactions = bus->get_transactions();
+  EXPECT_EQ(board->set_pwm_interval_broadcast(0, 0), 0u);
+  EXPECT_EQ(bus->get_transactions() - transactions, 1u);
+
+  // A uniform frame takes the same path.
+  write_frame(*board, std::vector<int>(16, 300));
+  uint64_t frames = board->metrics.frame_transactions.get_count();
+  uint64_t issued = board->metrics.writes_issued;
+  transactions = bus->get_transactions();
+  write_frame(*board, std::vector<int>(16, 0));
+  EXPECT_EQ(bus->get_transactions() - transactions, 1u);
+  EXPECT_EQ(board->metrics.frame_transactions.get_count() - frames, 0u);
+  EXPECT_EQ(board->metrics.writes_issued - issued, 16u);
+}
+
+TEST_F(BoardNodeTest, BoardAtTheAllcallAddressIsWrittenOnItsOwn) {
+  auto board = make_board(rclcpp::NodeOptions());
+  board->set_active_board(49);
+  board->set_active_board(1);
+
+  uint64_t missed = board->set_pwm_interval_broadcast(0, 0);
+  EXPECT_EQ(missed, (1ull << 0) | (1ull << 48));
+}
+
+TEST_F(BoardNodeTest, SharedBusIsBroadcastOnlyOnceEveryBoardIsUp) {
+  auto board = make_board(rclcpp::NodeOptions().append_parameter_override("i2c_bus_exclusive", false));
+  EXPECT_EQ(board->set_pwm_interval_broadcast(0, 0), 1u);
+
+  board = make_board(rclcpp::NodeOptions()
+                         .append_parameter_override("i2c_bus_exclusive", false)
+                         .append_parameter_override("i2c_bus_boards", 1));
+  EXPECT_EQ(board->set_pwm_interval_broadcast(0, 0), 0u);
+}
+
+TEST_F(BoardNodeTest, SameCalibrationKeepsTheServoTable) {
+  auto board = make_board(rclcpp::NodeOptions());
+  std::vector<smov::ServoCalibration> calibrations = {{1, 333, 100, -1}, {2, 336, 108, 1}};
+
+  EXPECT_EQ(board->config_servos(calibrations), 2);
+  EXPECT_EQ(board->config_servos(calibrations), 0);
+
+  // The table in use still converts with the calibration.
+  int servos[2] = {1, 2};
+  float values[2] = {1.0f, -1.0f};
+  uint64_t issued = board->metrics.writes_issued;
+  EXPECT_EQ(board->stage_pwm_intervals_proportional(servos, values, 2), 2);
+  board->write_pwm_frame();
+  EXPECT_EQ(board->metrics.writes_issued - issued, 2u);
+}
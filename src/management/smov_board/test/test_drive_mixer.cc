@@ -0,0 +1,127 @@
+//
+// Created by ros on 2/3/24.
+//
+
+#include <cmath>
+
+#include <gtest/gtest.h>
+
+#include "board_controller.h"
+#include "drive_mixer.h"
+
+namespace {
+
+const float RPM = 60.0f;
+const float RADIUS = 0.05f;
+const float TRACK = 0.2f;
+const float SCALE = 0.3f;
+
+// The wheel speeds of the original Twist handler, before the mixing matrix: left front, right front, left rear and
+// right rear, or only the first ones the mode drives.
+void baseline_mix(int mode, float linear_x, float linear_y, float angular_z, float *speed) {
+  float max_rate = static_cast<float>((RADIUS * M_PI * 2) * (RPM / 60.0));
+
+  float dir_x = linear_x < 0 ? -1.0f : 1.0f;
+  float dir_y = linear_y < 0 ? -1.0f : 1.0f;
+  float dir_r = angular_z < 0 ? -1.0f : 1.0f;
+  float temp_x = SCALE * std::abs(linear_x);
+  float temp_y = SCALE * std::abs(linear_y);
+  float delta = (TRACK / 2) * std::abs(angular_z);
+
+  float ratio = (temp_x + delta) / max_rate;
+  if (ratio > 1.0f)
+    temp_x /= ratio;
+
+  switch (mode) {
+    case smov::MODE_ACKERMAN:
+      speed[0] = temp_x * dir_x / max_rate;
+      if (std::abs(speed[0]) > 1.0f)
+        speed[0] = dir_x;
+      break;
+    case smov::MODE_DIFFERENTIAL:
+    case smov::MODE_MECANUM:
+      if (dir_r > 0) {
+        speed[0] = speed[2] = (temp_x + delta) * dir_x;
+        speed[1] = speed[3] = (temp_x - delta) * dir_x;
+      } else {
+        speed[0] = speed[2] = (temp_x - delta) * dir_x;
+        speed[1] = speed[3] = (temp_x + delta) * dir_x;
+      }
+      if (mode == smov::MODE_MECANUM) {
+        speed[0] += temp_y * dir_y;
+        speed[3] += temp_y * dir_y;
+        speed[1] -= temp_y * dir_y;
+        speed[2] -= temp_y * dir_y;
+      }
+      {
+        float range = 0.0f;
+        for (int wheel = 0; wheel < 4; wheel++)
+          range = std::max(range, std::abs(speed[wheel]));
+        ratio = range / max_rate;
+        for (int wheel = 0; wheel < 4; wheel++)
+          speed[wheel] = (ratio > 1.0f ? speed[wheel] / ratio : speed[wheel]) / max_rate;
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+void expect_baseline(int mode, int wheels) {
+  smov::DriveMixer mixer;
+  mixer.configure(mode, RPM, RADIUS, TRACK, SCALE);
+
+  const float inputs[] = {-2.0f, -0.7f, -0.1f, 0.0f, 0.25f, 0.9f, 3.0f};
+  for (float x : inputs) {
+    for (float y : inputs) {
+      for (float z : inputs) {
+        float expected[4] = {};
+        baseline_mix(mode, x, y, z, expected);
+        mixer.mix(x, y, z);
+        for (int wheel = 0; wheel < wheels; wheel++)
+          EXPECT_NEAR(mixer.get_wheel_speeds()[wheel], expected[wheel], 1e-5)
+              << "mode " << mode << " wheel " << wheel << " twist (" << x << ", " << y << ", " << z << ")";
+      }
+    }
+  }
+}
+
+}
+
+TEST(DriveMixer, AckermanMatchesTheBaseline) {
+  expect_baseline(smov::MODE_ACKERMAN, 1);
+}
+
+TEST(DriveMixer, DifferentialMatchesTheBaseline) {
+  expect_baseline(smov::MODE_DIFFERENTIAL, 2);
+}
+
+TEST(DriveMixer, MecanumMatchesTheBaseline) {
+  expect_baseline(smov::MODE_MECANUM, 4);
+}
+
+TEST(DriveMixer, ServosFollowTheirWheelPosition) {
+  smov::DriveMixer mixer;
+  mixer.configure(smov::MODE_DIFFERENTIAL, RPM, RADIUS, TRACK, SCALE);
+  mixer.set_position(7, smov::POSITION_LEFTFRONT);
+  mixer.set_position(8, smov::POSITION_RIGHTFRONT);
+  mixer.set_position(9, smov::POSITION_RIGHTREAR);
+
+  ASSERT_EQ(mixer.mix(0.2f, 0.0f, 0.5f), 3);
+  const float *speeds = mixer.get_wheel_speeds();
+  for (int i = 0; i < 3; i++) {
+    int servo = mixer.get_servos()[i];
+    float expected = servo == 7 ? speeds[0] : (servo == 8 ? speeds[1] : speeds[3]);
+    EXPECT_FLOAT_EQ(mixer.get_values()[i], expected);
+  }
+
+  // A servo taken off the drive is not mixed anymore.
+  mixer.set_position(9, smov::POSITION_UNDEFINED);
+  EXPECT_EQ(mixer.mix(0.2f, 0.0f, 0.5f), 2);
+}
+
+TEST(DriveMixer, UndefinedModeDrivesNothing) {
+  smov::DriveMixer mixer;
+  mixer.set_position(1, smov::POSITION_LEFTFRONT);
+  EXPECT_EQ(mixer.mix(1.0f, 0.0f, 0.0f), 0);
+}
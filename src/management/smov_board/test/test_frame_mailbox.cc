@@ -0,0 +1,64 @@
+//
+// Created by ros on 2/3/24.
+//
+
+#include <gtest/gtest.h>
+
+#include "frame_mailbox.h"
+
+namespace {
+
+void publish_frame(smov::FrameMailbox &mailbox, uint16_t value, bool expect_fresh) {
+  smov::PwmFrame &frame = mailbox.get_back();
+  frame.on[0] = 0;
+  frame.off[0] = value;
+  frame.mask = 1;
+  frame.stamp = value;
+  EXPECT_EQ(mailbox.publish(), expect_fresh);
+}
+
+}
+
+TEST(FrameMailbox, EmptyMailboxHasNothingToTake) {
+  smov::FrameMailbox mailbox;
+  EXPECT_EQ(mailbox.take(), nullptr);
+}
+
+TEST(FrameMailbox, TakesThePublishedFrameOnce) {
+  smov::FrameMailbox mailbox;
+  publish_frame(mailbox, 300, true);
+
+  const smov::PwmFrame *frame = mailbox.take();
+  ASSERT_NE(frame, nullptr);
+  EXPECT_EQ(frame->off[0], 300);
+  EXPECT_EQ(frame->mask, 1);
+  EXPECT_EQ(mailbox.take(), nullptr);
+}
+
+TEST(FrameMailbox, NewerFrameReplacesTheOneNotTaken) {
+  smov::FrameMailbox mailbox;
+  publish_frame(mailbox, 300, true);
+  publish_frame(mailbox, 310, false);
+  publish_frame(mailbox, 320, false);
+
+  const smov::PwmFrame *frame = mailbox.take();
+  ASSERT_NE(frame, nullptr);
+  EXPECT_EQ(frame->off[0], 320);
+  EXPECT_EQ(mailbox.take(), nullptr);
+}
+
+TEST(FrameMailbox, TakenFrameStaysValidWhileTheProducerGoesOn) {
+  smov::FrameMailbox mailbox;
+  publish_frame(mailbox, 300, true);
+  const smov::PwmFrame *frame = mailbox.take();
+  ASSERT_NE(frame, nullptr);
+
+  // The consumer owns its frame until its next take, whatever the producer publishes meanwhile.
+  publish_frame(mailbox, 310, true);
+  publish_frame(mailbox, 320, false);
+  EXPECT_EQ(frame->off[0], 300);
+
+  frame = mailbox.take();
+  ASSERT_NE(frame, nullptr);
+  EXPECT_EQ(frame->off[0], 320);
+}
@@ -0,0 +1,62 @@
+//
+// Created by ros on 2/3/24.
+//
+
+#include <gtest/gtest.h>
+
+#include "servo_table.h"
+
+TEST(ServoTable, ServosGetDenseSlots) {
+  smov::ServoTable table;
+  EXPECT_EQ(table.find(5), -1);
+  EXPECT_EQ(table.insert(5), 0);
+  EXPECT_EQ(table.insert(900), 1);
+  EXPECT_EQ(table.insert(5), 0);
+  EXPECT_EQ(table.find(900), 1);
+  EXPECT_EQ(table.size(), 2);
+
+  EXPECT_EQ(table.insert(0), -1);
+  EXPECT_EQ(table.insert(TABLE_MAX_SERVOS + 1), -1);
+  EXPECT_EQ(table.size(), 2);
+
+  table.clear();
+  EXPECT_EQ(table.size(), 0);
+  EXPECT_EQ(table.find(5), -1);
+}
+
+TEST(ServoTable, ConfigurePrecomputesTheConversion) {
+  smov::ServoTable table;
+  ASSERT_TRUE(table.configure(1, 333, 100, -1));
+
+  int slot = table.find(1);
+  ASSERT_GE(slot, 0);
+  EXPECT_FLOAT_EQ(table.scale[slot], -50.0f);
+  EXPECT_FLOAT_EQ(table.offset[slot], 333.0f);
+  EXPECT_FLOAT_EQ(table.low[slot], 283.0f);
+  EXPECT_FLOAT_EQ(table.high[slot], 383.0f);
+  EXPECT_EQ(table.mode_pos[slot], -1);
+}
+
+TEST(ServoTable, TravelIsClampedToTheCounter) {
+  smov::ServoTable table;
+  ASSERT_TRUE(table.configure(2, 4050, 200, 1));
+
+  int slot = table.find(2);
+  EXPECT_FLOAT_EQ(table.low[slot], 3950.0f);
+  EXPECT_FLOAT_EQ(table.high[slot], 4095.0f);
+}
+
+TEST(ServoTable, SameCalibrationLeavesTheTableUnchanged) {
+  smov::ServoTable table;
+  ASSERT_TRUE(table.configure(3, 300, 100, 1));
+  smov::ServoTable copy = table;
+
+  EXPECT_FALSE(table.configure(3, 300, 100, 1));
+  EXPECT_EQ(table.size(), copy.size());
+  EXPECT_EQ(table.center, copy.center);
+  EXPECT_EQ(table.scale, copy.scale);
+  EXPECT_EQ(table.offset, copy.offset);
+
+  EXPECT_TRUE(table.configure(3, 300, 100, -1));
+  EXPECT_FLOAT_EQ(table.scale[table.find(3)], -50.0f);
+}
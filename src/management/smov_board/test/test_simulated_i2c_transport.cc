@@ -0,0 +1,73 @@
+//
+// Created by ros on 2/3/24.
+//
+
+#include <gtest/gtest.h>
+
+#include "i2c_transport.h"
+#include "pca9685.h"
+
+namespace {
+
+// START and STOP, then the address, register and data bytes with their ACK.
+uint64_t write_time_ns(size_t length, int bus_speed) {
+  return (2 + 9 * (2 + length)) * 1000000000ull / static_cast<uint64_t>(bus_speed);
+}
+
+void enable_auto_increment(smov::SimulatedI2cTransport &bus, int address) {
+  uint8_t mode1 = smov::ALLCALL | smov::AUTO_INCREMENT;
+  ASSERT_TRUE(bus.write(address, smov::MODE1, &mode1, 1));
+}
+
+}
+
+TEST(SimulatedI2cTransport, WritesAreTimedAtTheBusSpeed) {
+  for (int bus_speed : {100000, 400000, 1000000}) {
+    smov::SimulatedI2cTransport bus(bus_speed);
+    uint8_t data[64] = {};
+    ASSERT_TRUE(bus.write(BASE_ADDR, smov::CHANNEL_ON_L, data, sizeof(data)));
+
+    EXPECT_EQ(bus.get_transactions(), 1u);
+    EXPECT_EQ(bus.get_bytes(), 66u);
+    EXPECT_EQ(bus.get_bus_time_ns(), write_time_ns(64, bus_speed));
+  }
+}
+
+TEST(SimulatedI2cTransport, RegistersBehaveLikeAPca9685) {
+  smov::SimulatedI2cTransport bus(400000);
+
+  // A board comes up asleep, listening to ALLCALL, without auto-increment.
+  uint8_t mode1 = 0;
+  ASSERT_TRUE(bus.read(BASE_ADDR, smov::MODE1, &mode1, 1));
+  EXPECT_EQ(mode1, smov::SLEEP | smov::ALLCALL);
+
+  uint8_t values[4] = {1, 2, 3, 4};
+  ASSERT_TRUE(bus.write(BASE_ADDR, smov::CHANNEL_ON_L, values, 4));
+  uint8_t read[4] = {};
+  ASSERT_TRUE(bus.read(BASE_ADDR, smov::CHANNEL_ON_L, read, 1));
+  EXPECT_EQ(read[0], 4);
+
+  enable_auto_increment(bus, BASE_ADDR);
+  ASSERT_TRUE(bus.write(BASE_ADDR, smov::CHANNEL_ON_L, values, 4));
+  ASSERT_TRUE(bus.read(BASE_ADDR, smov::CHANNEL_ON_L, read, 4));
+  EXPECT_EQ(read[0], 1);
+  EXPECT_EQ(read[3], 4);
+}
+
+TEST(SimulatedI2cTransport, BroadcastReachesTheBoardsListeningToAllcall) {
+  smov::SimulatedI2cTransport bus(400000);
+  enable_auto_increment(bus, BASE_ADDR);
+  uint8_t mode1 = smov::AUTO_INCREMENT;
+  ASSERT_TRUE(bus.write(BASE_ADDR + 1, smov::MODE1, &mode1, 1));
+
+  uint8_t values[4] = {0, 0, 0x2C, 0x01};
+  ASSERT_TRUE(bus.write(ALLCALL_ADDR, smov::ALL_CHANNELS_ON_L, values, 4));
+
+  uint8_t read[4] = {};
+  ASSERT_TRUE(bus.read(BASE_ADDR, smov::ALL_CHANNELS_ON_L, read, 4));
+  EXPECT_EQ(read[2], 0x2C);
+  EXPECT_EQ(read[3], 0x01);
+  ASSERT_TRUE(bus.read(BASE_ADDR + 1, smov::ALL_CHANNELS_ON_L, read, 4));
+  EXPECT_EQ(read[2], 0);
+  EXPECT_EQ(read[3], 0);
+}
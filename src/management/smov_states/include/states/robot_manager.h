@@ -27,6 +27,9 @@ class RobotManager {
   // When using a single board.
   smov_board_msgs::msg::ServoArray single_back_array;
 
+  // When using a single board, both halves are published together as one array.
+  smov_board_msgs::msg::ServoArray single_body_array;
+
   // Arrays to publish in the absolute publisher.
   smov_board_msgs::msg::ServoArray front_abs_array;
   smov_board_msgs::msg::ServoArray back_abs_array;
@@ -44,7 +47,9 @@ class RobotManager {
   std::vector<std::vector<long int>> front_servos_data;
   std::vector<std::vector<long int>> back_servos_data;
 
+  // The state owning the servos: its name is only used for the logs and the LCD panel, messages carry its ID.
   std::string state = "None";
+  uint16_t state_id = 0;
 
   std::array<std::string, 12> servo_name = {"AVCG", "AVCD", "AVBG",
                                             "AVBD", "AVJG", "AVJD",
@@ -1,38 +1,113 @@
 #ifndef ROBOT_NODE_HANDLER_H_
 #define ROBOT_NODE_HANDLER_H_
 
+#include <atomic>
+#include <mutex>
+
 #include <states/robot_manager.h>
+#include <states/source_watchdog.h>
+#include <states/state_arbiter.h>
+#include <states/trajectory.h>
 
+#include <diagnostic_msgs/msg/diagnostic_array.hpp>
+#include <std_msgs/msg/u_int64.hpp>
 #include <std_srvs/srv/empty.hpp>
 
 #include "smov_board_msgs/srv/servos_config.hpp"
 #include "smov_board_msgs/msg/servo_config.hpp"
+#include "smov_board_msgs/msg/servo_frame.hpp"
 #include "smov_states_msgs/msg/states_servos.hpp"
 #include "smov_states_msgs/msg/end_state.hpp"
+#include "smov_states_msgs/msg/body_servos.hpp"
+#include "smov_states_msgs/msg/body_trajectory.hpp"
+#include "smov_states_msgs/srv/register_state.hpp"
 #include "smov_monitor_msgs/msg/display_text.hpp"
 
 namespace smov {
 
 class RobotNodeHandle : public rclcpp::Node {
  public:
-  RobotNodeHandle();
+  explicit RobotNodeHandle(const rclcpp::NodeOptions &options = rclcpp::NodeOptions());
 
   static bool use_single_board;
 
   void declare_parameters();
   void set_up_topics();
   void config_servos();
-  void late_callback();
+  void send_config_requests();
+  void servos_configured(bool front);
+  rcl_interfaces::msg::SetParametersResult calibration_callback(const std::vector<rclcpp::Parameter> &parameters);
+  static smov_board_msgs::msg::ServoConfig make_servo_config(const std::vector<long int> &data);
+  void publish_state();
+  void publish_diagnostics();
   void front_topic_callback(smov_states_msgs::msg::StatesServos::SharedPtr msg);
   void back_topic_callback(smov_states_msgs::msg::StatesServos::SharedPtr msg);
+  void body_topic_callback(smov_states_msgs::msg::BodyServos::SharedPtr msg);
+  void trajectory_topic_callback(smov_states_msgs::msg::BodyTrajectory::SharedPtr msg);
+  void trajectory_callback();
   void end_state_callback(smov_states_msgs::msg::EndState::SharedPtr msg);
+  void register_state_callback(std::shared_ptr<smov_states_msgs::srv::RegisterState::Request> req,
+                               std::shared_ptr<smov_states_msgs::srv::RegisterState::Response> res);
+  void warn_unknown_state(uint16_t state_id);
+  void forward_servos(uint16_t state_id, const float *values, int first, int count);
+  void write_outputs(const float *output, int first, int count);
+  void publish_outputs(bool front, bool back);
+  void arbitration_callback();
+  void take_servos(uint16_t state_id);
+  void free_servos();
+  std::mutex &half_mutex(bool front);
+  static int64_t steady_now();
   void stop_servos();
+  void publish_servos(bool front, const smov_board_msgs::msg::ServoArray &servos);
+  void publish_frame(const rclcpp::Publisher<smov_board_msgs::msg::ServoFrame>::SharedPtr &publisher,
+                     const smov_board_msgs::msg::ServoArray &servos);
+
+  // Publish fixed size ServoFrame messages instead of ServoArray ones.
+  bool use_servo_frames = false;
+  std::atomic<uint32_t> frame_sequence{0};
+
+  // Front and back halves are forwarded from their own groups, so a pose for one half never waits behind the other.
+  // Registration, end of states, service responses and diagnostics run in the housekeeping group.
+  rclcpp::CallbackGroup::SharedPtr front_group;
+  rclcpp::CallbackGroup::SharedPtr back_group;
+  rclcpp::CallbackGroup::SharedPtr housekeeping_group;
+
+  // Guard the arrays of each half. With a single board both halves go through the front one.
+  std::mutex front_mutex;
+  std::mutex back_mutex;
+
+  // Guards the registered states and the arbiter. Taken after the mutexes of the halves, never before.
+  std::mutex state_mutex;
+
+  // Decides which state drives the servos, and blends the servos when another state takes them.
+  smov::StateArbiter arbiter;
+  int state_lease_ms = 0;
+  rclcpp::TimerBase::SharedPtr arbitration_timer;
+
+  // Watches every state on the steady clock, and catches the one driving the servos when it misses its deadline.
+  smov::SourceWatchdog watchdog;
+  bool watchdog_stops = false; // Stop the servos instead of moving them to the safe pose.
+  float safe_pose[ARBITER_SERVOS]{};
+
+  // Trajectory played back by the trajectory timer for its state, 0 when none is playing. Guarded by the state mutex.
+  smov::Trajectory trajectory;
+  uint16_t trajectory_state = 0;
+  int64_t trajectory_start = 0;
+  rclcpp::TimerBase::SharedPtr trajectory_timer;
+
+  // Calibrations waiting for their board service to come up, sent by the config timer.
+  std::shared_ptr<smov_board_msgs::srv::ServosConfig::Request> front_config_request;
+  std::shared_ptr<smov_board_msgs::srv::ServosConfig::Request> back_config_request;
+  rclcpp::TimerBase::SharedPtr config_timer;
+
+  // Pushes the calibration changes of the servo parameters to the boards.
+  rclcpp::Node::OnSetParametersCallbackHandle::SharedPtr calibration_callback_handle;
 
   // Used for fast operations
   rclcpp::TimerBase::SharedPtr timer;
 
-  // Used for non-necessary fast operations
-  rclcpp::TimerBase::SharedPtr late_timer;
+  // Publishes the servo values and the current state when diagnostics are enabled.
+  rclcpp::TimerBase::SharedPtr diagnostics_timer;
 
   // Used to publish on the LCD panel.
   smov_monitor_msgs::msg::DisplayText up_display;
@@ -45,9 +120,19 @@ class RobotNodeHandle : public rclcpp::Node {
 
   rclcpp::Subscription<smov_states_msgs::msg::StatesServos>::SharedPtr front_states_sub;
   rclcpp::Subscription<smov_states_msgs::msg::StatesServos>::SharedPtr back_states_sub;
+  rclcpp::Subscription<smov_states_msgs::msg::BodyServos>::SharedPtr body_states_sub;
+  rclcpp::Subscription<smov_states_msgs::msg::BodyTrajectory>::SharedPtr body_trajectory_sub;
 
   rclcpp::Subscription<smov_states_msgs::msg::EndState>::SharedPtr end_state_sub;
 
+  // Names of the registered states, the ID of a state is its index + 1.
+  std::vector<std::string> state_names;
+  rclcpp::Service<smov_states_msgs::srv::RegisterState>::SharedPtr register_state_srv;
+
+  // Identifies this run of the manager, announced to the states so they register again after a restart.
+  uint64_t session = 0;
+  rclcpp::Publisher<std_msgs::msg::UInt64>::SharedPtr session_pub;
+
   rclcpp::Client<smov_board_msgs::srv::ServosConfig>::SharedPtr front_servo_config_client;
   rclcpp::Client<smov_board_msgs::srv::ServosConfig>::SharedPtr back_servo_config_client;
 
@@ -60,7 +145,11 @@ class RobotNodeHandle : public rclcpp::Node {
   rclcpp::Publisher<smov_board_msgs::msg::ServoArray>::SharedPtr front_abs_pub;
   rclcpp::Publisher<smov_board_msgs::msg::ServoArray>::SharedPtr back_abs_pub;
 
+  rclcpp::Publisher<smov_board_msgs::msg::ServoFrame>::SharedPtr front_frame_pub;
+  rclcpp::Publisher<smov_board_msgs::msg::ServoFrame>::SharedPtr back_frame_pub;
+
   rclcpp::Publisher<smov_monitor_msgs::msg::DisplayText>::SharedPtr monitor_pub;
+  rclcpp::Publisher<diagnostic_msgs::msg::DiagnosticArray>::SharedPtr diagnostics_pub;
 };
 
 } // namespace smov
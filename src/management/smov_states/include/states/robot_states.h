@@ -2,17 +2,22 @@
 #define ROBOT_STATES_H_
 
 #include <ctime>
+#include <functional>
 #include <unistd.h>
 #include <fcntl.h>
 #include <termios.h>
 #include <thread>
 
 #include "std_msgs/msg/string.hpp"
+#include "std_msgs/msg/u_int64.hpp"
 
 #include <states/robot_manager.h>
 
 #include "smov_states_msgs/msg/states_servos.hpp"
 #include "smov_states_msgs/msg/end_state.hpp"
+#include "smov_states_msgs/msg/body_servos.hpp"
+#include "smov_states_msgs/msg/body_trajectory.hpp"
+#include "smov_states_msgs/srv/register_state.hpp"
 
 namespace smov {
 
@@ -30,29 +35,98 @@ enum RobotParts {
   RIGHT_LEG
 };
 
+// Copies the front and back halves into a whole-body message, front servos first.
+inline void fill_body_servos(smov_states_msgs::msg::BodyServos &body,
+                             const smov_states_msgs::msg::StatesServos &front,
+                             const smov_states_msgs::msg::StatesServos &back) {
+  body.state_id = front.state_id;
+  for (size_t i = 0; i < front.value.size(); i++) {
+    body.value[i] = front.value[i];
+    body.value[i + front.value.size()] = back.value[i];
+  }
+}
+
+// Appends a whole-body keyframe at a time in ms from the start of the trajectory, front servos first.
+inline void add_keyframe(smov_states_msgs::msg::BodyTrajectory &trajectory,
+                         uint32_t time_ms,
+                         const smov_states_msgs::msg::StatesServos &front,
+                         const smov_states_msgs::msg::StatesServos &back) {
+  trajectory.time_ms.push_back(time_ms);
+  trajectory.value.insert(trajectory.value.end(), front.value.begin(), front.value.end());
+  trajectory.value.insert(trajectory.value.end(), back.value.begin(), back.value.end());
+}
+
+// Asks the states manager for the ID of a state, waiting until it answers with one. Throws if interrupted.
+// A state with a higher priority takes the servos from the others. A state driving the servos that sends no values
+// for deadline_ms is stopped by the manager, 0 uses the deadline of the manager. The session of the manager that gave
+// the ID is written to session if given.
+uint16_t register_state(rclcpp::Node *node, const std::string &state_name, uint8_t priority = 0,
+                        uint16_t deadline_ms = 0, uint64_t *session = nullptr);
+
+// Keeps a state registered with the states manager. The state waits for its ID when constructed, then registers
+// again, without blocking its node, whenever another session of the manager is announced, e.g. after a restart.
+// set_id receives 0 while the state is not registered.
+class StateRegistration {
+ public:
+  StateRegistration(rclcpp::Node *node, const std::string &state_name, uint8_t priority, uint16_t deadline_ms,
+                    std::function<void(uint16_t)> set_id);
+
+ private:
+  void session_callback(std_msgs::msg::UInt64::SharedPtr msg);
+  void send_request();
+
+  rclcpp::Node *node;
+  std::function<void(uint16_t)> set_id;
+  uint64_t session; // Session of the manager the state is registered with.
+  std::shared_ptr<smov_states_msgs::srv::RegisterState::Request> request;
+  rclcpp::Client<smov_states_msgs::srv::RegisterState>::SharedPtr client;
+  rclcpp::Subscription<std_msgs::msg::UInt64>::SharedPtr session_sub;
+  rclcpp::TimerBase::SharedPtr retry_timer;
+};
+
 #define STATE_CLASS(name) void on_start();\
                           void on_loop();\
                           void on_quit();\
-                          void set_name() {front_servos.state_name = name; back_servos.state_name = name; end_state.state_name = name;}\
+                          void set_name() {end_state.state_name = name;}\
+                          void set_id(uint16_t id) {front_servos.state_id = id; back_servos.state_id = id; body_servos.state_id = id; body_trajectory.state_id = id; end_state.state_id = id;}\
+                          void publish_body() {fill_body_servos(body_servos, front_servos, back_servos); body_state_publisher->publish(body_servos);}\
+                          void publish_trajectory() {trajectory_publisher->publish(body_trajectory); body_trajectory.time_ms.clear(); body_trajectory.mask.clear(); body_trajectory.value.clear();}\
                           void delay(int time) {struct timespec ts = {0,0}; ts.tv_sec = time / 1000; ts.tv_nsec = (time % 1000) * 1000000; nanosleep(&ts, NULL);}\
                           public: void end_program() {end_state_publisher->publish(end_state);}\
                           smov_states_msgs::msg::StatesServos front_servos;\
                           smov_states_msgs::msg::StatesServos back_servos;\
+                          smov_states_msgs::msg::BodyServos body_servos;\
+                          smov_states_msgs::msg::BodyTrajectory body_trajectory;\
                           smov_states_msgs::msg::EndState end_state;\
                           rclcpp::Publisher<smov_states_msgs::msg::StatesServos>::SharedPtr front_state_publisher;\
                           rclcpp::Publisher<smov_states_msgs::msg::StatesServos>::SharedPtr back_state_publisher;\
+                          rclcpp::Publisher<smov_states_msgs::msg::BodyServos>::SharedPtr body_state_publisher;\
+                          rclcpp::Publisher<smov_states_msgs::msg::BodyTrajectory>::SharedPtr trajectory_publisher;\
                           rclcpp::Publisher<smov_states_msgs::msg::EndState>::SharedPtr end_state_publisher;\
 
 #define STATE_LIBRARY_CLASS(name) smov_states_msgs::msg::StatesServos* front_servos;\
                                   smov_states_msgs::msg::StatesServos* back_servos;\
+                                  smov_states_msgs::msg::BodyServos body_servos;\
                                   void delay(int time) {struct timespec ts = {0,0}; ts.tv_sec = time / 1000; ts.tv_nsec = (time % 1000) * 1000000; nanosleep(&ts, NULL);}\
+                                  void publish_body() {\
+                                    if (body_state_publisher == nullptr) {\
+                                      (*front_state_publisher)->publish(*front_servos);\
+                                      (*back_state_publisher)->publish(*back_servos);\
+                                      return;\
+                                    }\
+                                    fill_body_servos(body_servos, *front_servos, *back_servos);\
+                                    (*body_state_publisher)->publish(body_servos);\
+                                  }\
                                   rclcpp::Publisher<smov_states_msgs::msg::StatesServos>::SharedPtr* front_state_publisher;\
                                   rclcpp::Publisher<smov_states_msgs::msg::StatesServos>::SharedPtr* back_state_publisher;\
+                                  rclcpp::Publisher<smov_states_msgs::msg::BodyServos>::SharedPtr* body_state_publisher = nullptr;\
                                   name(smov_states_msgs::msg::StatesServos* f_servos, smov_states_msgs::msg::StatesServos* b_servos,\
                                    rclcpp::Publisher<smov_states_msgs::msg::StatesServos>::SharedPtr* f_pub,\
-                                   rclcpp::Publisher<smov_states_msgs::msg::StatesServos>::SharedPtr* b_pub)\
+                                   rclcpp::Publisher<smov_states_msgs::msg::StatesServos>::SharedPtr* b_pub,\
+                                   rclcpp::Publisher<smov_states_msgs::msg::BodyServos>::SharedPtr* body_pub = nullptr)\
                                    : front_servos(f_servos), back_servos(b_servos),\
-                                   front_state_publisher(f_pub), back_state_publisher(b_pub) { }\
+                                   front_state_publisher(f_pub), back_state_publisher(b_pub),\
+                                   body_state_publisher(body_pub) { }\
 
 #define DECLARE_STATE_NODE_CLASS(node_name, state_class, timeout)\
   using namespace std::chrono_literals;\
@@ -63,11 +137,19 @@ enum RobotParts {
     StateNode()\
     : Node(node_name), count(0) {\
       state.set_name();\
+      registration = std::make_unique<smov::StateRegistration>(this, state.end_state.state_name,\
+          static_cast<uint8_t>(this->declare_parameter("state_priority", 0)),\
+          static_cast<uint16_t>(this->declare_parameter("state_deadline_ms", 0)),\
+          [](uint16_t id) {state.set_id(id);});\
       init_reader(0);\
       state.front_state_publisher =\
         this->create_publisher<smov_states_msgs::msg::StatesServos>("front_proportional_servos", 50);\
       state.back_state_publisher =\
         this->create_publisher<smov_states_msgs::msg::StatesServos>("back_proportional_servos", 50);\
+      state.body_state_publisher =\
+        this->create_publisher<smov_states_msgs::msg::BodyServos>("body_proportional_servos", 50);\
+      state.trajectory_publisher =\
+        this->create_publisher<smov_states_msgs::msg::BodyTrajectory>("body_trajectory", 10);\
       state.end_state_publisher =\
         this->create_publisher<smov_states_msgs::msg::EndState>("end_state", 1);\
       timer = this->create_wall_timer(timeout, std::bind(&StateNode::timer_callback, this));\
@@ -86,6 +168,7 @@ enum RobotParts {
       tcsetattr(0, TCSANOW, &new_chars);\
     }\
     size_t count;\
+    std::unique_ptr<smov::StateRegistration> registration;\
     rclcpp::TimerBase::SharedPtr timer;\
     rclcpp::TimerBase::SharedPtr quick_timer;\
   };\
@@ -122,11 +205,19 @@ enum RobotParts {
     StateNode()\
     : Node(node_name), count(0) {\
       state.set_name();\
+      registration = std::make_unique<smov::StateRegistration>(this, state.end_state.state_name,\
+          static_cast<uint8_t>(this->declare_parameter("state_priority", 0)),\
+          static_cast<uint16_t>(this->declare_parameter("state_deadline_ms", 0)),\
+          [](uint16_t id) {state.set_id(id);});\
       init_reader(0);\
       state.front_state_publisher =\
         this->create_publisher<smov_states_msgs::msg::StatesServos>("front_proportional_servos", 50);\
       state.back_state_publisher =\
         this->create_publisher<smov_states_msgs::msg::StatesServos>("back_proportional_servos", 50);\
+      state.body_state_publisher =\
+        this->create_publisher<smov_states_msgs::msg::BodyServos>("body_proportional_servos", 50);\
+      state.trajectory_publisher =\
+        this->create_publisher<smov_states_msgs::msg::BodyTrajectory>("body_trajectory", 10);\
       state.end_state_publisher =\
         this->create_publisher<smov_states_msgs::msg::EndState>("end_state", 1);\
       timer = this->create_wall_timer(timeout, std::bind(&StateNode::timer_callback, this));\
@@ -145,6 +236,7 @@ enum RobotParts {
       tcsetattr(0, TCSANOW, &new_chars);\
     }\
     size_t count;\
+    std::unique_ptr<smov::StateRegistration> registration;\
     rclcpp::TimerBase::SharedPtr timer;\
     rclcpp::TimerBase::SharedPtr quick_timer;\
   };\
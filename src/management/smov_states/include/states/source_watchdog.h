@@ -0,0 +1,64 @@
+#ifndef SOURCE_WATCHDOG_H_
+#define SOURCE_WATCHDOG_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace smov {
+
+enum SourceStream {
+  STREAM_FRONT = 0,
+  STREAM_BACK = 1,
+  STREAM_BODY = 2,
+  STREAM_TRAJECTORY = 3,
+  STREAM_COUNT = 4
+};
+
+// Inter-arrival statistics of one topic of a state, in nanoseconds.
+struct StreamStats {
+  uint64_t count = 0;     // Messages received.
+  int64_t last = 0;       // When the last message arrived, 0 before the first one.
+  double mean = 0.0;      // Mean interval between two messages.
+  double m2 = 0.0;        // Sum of the squared deviations from the mean, the variance is m2 / (count - 2).
+  int64_t max = 0;        // Longest interval.
+  double max_jitter = 0.0; // Largest deviation of an interval from the mean.
+
+  std::string to_string() const;
+};
+
+// Watches the states sending values, on the steady clock.
+//
+// Every message of a state is recorded with its arrival time, which gives the age of the last values of the state
+// and the inter-arrival jitter of each of its topics. A state whose last values are older than its deadline is late.
+// Times are in steady clock nanoseconds. The class is not thread safe.
+class SourceWatchdog {
+ public:
+  SourceWatchdog();
+
+  void configure(int64_t deadline);
+  void register_source(uint16_t source, int64_t deadline);
+  void record(uint16_t source, SourceStream stream, int64_t now);
+  void keep_alive(uint16_t source, int64_t now);
+  void forget(uint16_t source);
+  bool is_late(uint16_t source, int64_t now) const;
+  int64_t get_age(uint16_t source, int64_t now) const;
+  int64_t get_deadline(uint16_t source) const;
+  const StreamStats &get_stats(uint16_t source, SourceStream stream) const;
+  uint64_t get_misses(uint16_t source) const;
+  void count_miss(uint16_t source);
+  uint16_t get_source_count() const;
+
+ private:
+  int64_t default_deadline;
+
+  // Indexed by source ID, entry 0 being unused.
+  std::vector<int64_t> deadlines;  // 0 uses the default deadline.
+  std::vector<int64_t> last_values; // When the source last sent values, 0 once it ended.
+  std::vector<uint64_t> misses;     // Times the source missed its deadline while driving the servos.
+  std::vector<StreamStats> stats;   // STREAM_COUNT entries per source.
+};
+
+} // namespace smov
+
+#endif // SOURCE_WATCHDOG_H_
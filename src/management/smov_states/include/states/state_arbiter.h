@@ -0,0 +1,74 @@
+#ifndef STATE_ARBITER_H_
+#define STATE_ARBITER_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <states/robot_manager.h>
+
+#define ARBITER_SERVOS (2 * SERVO_MAX_SIZE)
+
+namespace smov {
+
+enum ArbiterDecision {
+  ARBITER_REJECT = 0,   // Another state holds the servos, the values are dropped.
+  ARBITER_ACCEPT = 1,   // The state holds the servos.
+  ARBITER_TAKEOVER = 2  // The state just took the servos, from nobody or from a state it preempts.
+};
+
+// Decides which registered state drives the servos.
+//
+// A state holds the servos as long as it keeps sending values within its lease. A state with a higher priority takes
+// them over at once, and a free robot goes to the live state with the highest priority. Whether a state preempts
+// another is read from a table rebuilt on each registration. On a handover the servos move from where the previous
+// state left them to the values of the new one over the blend time, front servos on [0;5], back servos on [6;11].
+// Times are in steady clock nanoseconds. The class is not thread safe.
+class StateArbiter {
+ public:
+  StateArbiter();
+
+  void configure(int64_t lease, int64_t blend);
+  void register_state(uint16_t state_id, uint8_t priority);
+  ArbiterDecision decide(uint16_t state_id, int64_t now);
+  bool release(uint16_t state_id);
+  uint16_t expire(int64_t now);
+  void hold(const float *pose, int64_t now);
+
+  void set_target(int servo, float value);
+  float get_target(int servo) const;
+  void set_output(int servo, float value);
+  float get_output(int servo, int64_t now);
+  bool advance_blend(int64_t now);
+
+  uint16_t get_owner() const;
+
+ private:
+  bool is_live(uint16_t state_id, int64_t now) const;
+  bool preempts(uint16_t state_id, uint16_t other) const;
+  void take(uint16_t state_id, int64_t now);
+  void start_blend(int64_t now);
+
+  int64_t lease_ns;
+  int64_t blend_ns;
+  uint16_t owner; // 0 when no state holds the servos.
+
+  // Indexed by state ID, entry 0 being unused: the priority of each state, and when it last sent values (0 once it
+  // ended or was never heard of).
+  std::vector<uint8_t> priorities;
+  std::vector<int64_t> last_seen;
+
+  // preempt_table[a * priorities.size() + b] is 1 when state a takes the servos from state b.
+  std::vector<uint8_t> preempt_table;
+
+  // Values last sent to the servos, values requested by the owner, and where the current blend started from.
+  float output[ARBITER_SERVOS]{};
+  float target[ARBITER_SERVOS]{};
+  float blend_from[ARBITER_SERVOS]{};
+  int64_t blend_start;
+  int64_t blend_end;
+  bool blending;
+};
+
+} // namespace smov
+
+#endif // STATE_ARBITER_H_
@@ -0,0 +1,46 @@
+#ifndef TRAJECTORY_H_
+#define TRAJECTORY_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <states/state_arbiter.h>
+
+namespace smov {
+
+// Timed keyframes of every servo of the body, front servos on [0;5], back servos on [6;11].
+//
+// Each servo has its own keyframes, interpolated linearly or with a cubic Hermite spline whose tangents come from the
+// neighbouring keyframes, at rest on the first and last ones. A servo starts from where it was when the trajectory
+// was loaded. Times are in ms from the start of the trajectory.
+class Trajectory {
+ public:
+  Trajectory();
+
+  bool load(bool use_cubic,
+            const std::vector<uint32_t> &times,
+            const std::vector<uint16_t> &masks,
+            const std::vector<float> &values,
+            const float *start,
+            std::string &error);
+  void sample(double time, float *output) const;
+  bool is_done(double time) const;
+  double get_duration() const;
+
+ private:
+  struct Keyframes {
+    std::vector<double> times;
+    std::vector<float> values;
+  };
+
+  float sample_servo(const Keyframes &keyframes, double time) const;
+
+  Keyframes servos[ARBITER_SERVOS];
+  bool cubic;
+  double duration;
+};
+
+} // namespace smov
+
+#endif // TRAJECTORY_H_
@@ -2,9 +2,13 @@
 #include <states/robot_manager.h>
 
 int main(int argc, char *argv[]) {
-  auto node = std::make_shared<smov::RobotNodeHandle>();
   rclcpp::init(argc, argv);
-  rclcpp::spin(node);
+  auto node = std::make_shared<smov::RobotNodeHandle>();
+
+  // One thread for each half, one for the housekeeping and one for the parameter services.
+  rclcpp::executors::MultiThreadedExecutor executor(rclcpp::ExecutorOptions(), 4);
+  executor.add_node(node);
+  executor.spin();
   node->stop_servos();
   rclcpp::shutdown();
   return 0;
@@ -32,6 +32,14 @@ void RobotManager::set_up_servos() {
       single_back_array.servos[i].value = static_cast<float>(back_servos_data[i][4]);
     }
   }
+
+  if (RobotNodeHandle::use_single_board) {
+    single_body_array.servos.clear();
+    single_body_array.servos.insert(single_body_array.servos.end(),
+                                    front_prop_array.servos.begin(), front_prop_array.servos.end());
+    single_body_array.servos.insert(single_body_array.servos.end(),
+                                    single_back_array.servos.begin(), single_back_array.servos.end());
+  }
 }
 void RobotManager::stop_servos() {
   RCLCPP_FATAL(rclcpp::get_logger("rclcpp"), "RobotManager::stop_servos_handler is not implemented");
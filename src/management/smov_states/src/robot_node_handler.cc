@@ -1,14 +1,17 @@
+#include <algorithm>
 #include <iostream>
 #include <memory>
 
+#include <rclcpp_components/register_node_macro.hpp>
+
 #include <states/robot_node_handler.h>
 
 namespace smov {
 
 bool RobotNodeHandle::use_single_board = false;
 
-RobotNodeHandle::RobotNodeHandle()
-    : Node("smov_states") {
+RobotNodeHandle::RobotNodeHandle(const rclcpp::NodeOptions &options)
+    : Node("smov_states", options) {
 
   // Declaring the different parameters.
   declare_parameters();
@@ -32,24 +35,74 @@ RobotNodeHandle::RobotNodeHandle()
   // Default configuration.
   robot->set_up_servos();
 
+  // The first state to take the servos blends from their initial values, which are also the safe pose.
+  for (int i = 0; i < SERVO_MAX_SIZE; i++) {
+    safe_pose[i] = robot->front_prop_array.servos[i].value;
+    safe_pose[i + SERVO_MAX_SIZE] = robot->back_prop_array.servos[i].value;
+  }
+  for (int i = 0; i < ARBITER_SERVOS; i++)
+    arbiter.set_output(i, safe_pose[i]);
+
   // Setting up the publishers.
   set_up_topics();
 
   // Setting the display lines.
   up_display.line = 1;
 
-  // Configuring the proportional servos with their defined values.
+  // Configuring the proportional servos with their defined values, each board then gets its initial values.
   config_servos();
 
-  // Publishing the proportional values.
-  front_prop_pub->publish(robot->front_prop_array);
-  if (use_single_board)
-    front_prop_pub->publish(robot->single_back_array);
-  else
-    back_prop_pub->publish(robot->back_prop_array);
+  // From then on, changing a servo parameter recalibrates it on its board.
+  calibration_callback_handle = this->add_on_set_parameters_callback(
+      std::bind(&RobotNodeHandle::calibration_callback, this, std::placeholders::_1));
+
+  // A state holds the servos as long as it sends values within its lease, a state with a higher priority takes them at
+  // once. Either way, the servos move from the previous values to the new ones over the blend time.
+  state_lease_ms = static_cast<int>(this->declare_parameter("state_lease_ms", 2000));
+  int blend_ms = static_cast<int>(this->declare_parameter("handover_blend_ms", 250));
+  arbiter.configure(std::max(state_lease_ms, 0) * 1000000ll, std::max(blend_ms, 0) * 1000000ll);
+
+  // A state driving the servos that misses its deadline, e.g. stuck in a delay(), has the servos moved to the safe
+  // pose or stopped. States may register a deadline of their own, 0 disables the watchdog.
+  int deadline_ms = static_cast<int>(this->declare_parameter("watchdog_deadline_ms", 0));
+  watchdog.configure(std::max(deadline_ms, 0) * 1000000ll);
+  std::string action = this->declare_parameter("watchdog_action", std::string("safe_pose"));
+  if ((action != "safe_pose") && (action != "stop"))
+    RCLCPP_WARN(this->get_logger(), "Invalid watchdog action %s :: action must be one of safe_pose or stop",
+                action.c_str());
+  watchdog_stops = action == "stop";
+
+  // Leases, deadlines and blends are checked every 20 ms, which bounds how late a stalled state is caught.
+  arbitration_timer = this->create_wall_timer(std::chrono::milliseconds(20),
+                                              std::bind(&RobotNodeHandle::arbitration_callback, this),
+                                              housekeeping_group);
+
+  // Trajectories are sampled at a fixed rate, the timer only runs while one is playing.
+  int rate = static_cast<int>(this->declare_parameter("trajectory_rate_hz", 50));
+  if (rate <= 0) {
+    RCLCPP_WARN(this->get_logger(), "Invalid trajectory rate %d Hz :: falling back to 50 Hz", rate);
+    rate = 50;
+  }
+  trajectory_timer = this->create_wall_timer(std::chrono::microseconds(1000000 / rate),
+                                             std::bind(&RobotNodeHandle::trajectory_callback, this),
+                                             housekeeping_group);
+  trajectory_timer->cancel();
+
+  // Showing the initial state on the panel, it is then updated on every state change.
+  {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    publish_state();
+  }
 
-  // Calling the loops with some timeouts.
-  late_timer = this->create_wall_timer(std::chrono::seconds(1), std::bind(&RobotNodeHandle::late_callback, this));
+  // The servo values and the current state are only published on request, at most 10 times per second.
+  int period = static_cast<int>(this->declare_parameter("diagnostics_period_ms", 0));
+  if (period > 0) {
+    period = std::max(period, 100);
+    diagnostics_pub = this->create_publisher<diagnostic_msgs::msg::DiagnosticArray>("diagnostics", 10);
+    diagnostics_timer = this->create_wall_timer(std::chrono::milliseconds(period),
+                                                std::bind(&RobotNodeHandle::publish_diagnostics, this),
+                                                housekeeping_group);
+  }
 }
 
 // Publishing the absolute values.
@@ -58,50 +111,323 @@ RobotNodeHandle::RobotNodeHandle()
 // back_abs_pub->publish(robot->back_abs_array);
 
 void RobotNodeHandle::front_topic_callback(smov_states_msgs::msg::StatesServos::SharedPtr msg) {
-  if (robot->state == "None") {
-    robot->state = msg->state_name.c_str();
-    RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "===========================================");
-    RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Detecting a new state: %s", robot->state.c_str());
-    RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "===========================================");
+  forward_servos(msg->state_id, msg->value.data(), 0, SERVO_MAX_SIZE);
+}
+
+void RobotNodeHandle::back_topic_callback(smov_states_msgs::msg::StatesServos::SharedPtr msg) {
+  forward_servos(msg->state_id, msg->value.data(), SERVO_MAX_SIZE, SERVO_MAX_SIZE);
+}
+
+// One pose for the whole body: with a single board, both halves reach it as one array and are written in one burst.
+void RobotNodeHandle::body_topic_callback(smov_states_msgs::msg::BodyServos::SharedPtr msg) {
+  forward_servos(msg->state_id, msg->value.data(), 0, 2 * SERVO_MAX_SIZE);
+}
+
+// A whole trajectory in one message: the manager plays it back at a fixed rate, whatever the delivery timing.
+void RobotNodeHandle::trajectory_topic_callback(smov_states_msgs::msg::BodyTrajectory::SharedPtr msg) {
+  std::lock_guard<std::mutex> lock(state_mutex);
+  int64_t now = steady_now();
+
+  watchdog.record(msg->state_id, smov::STREAM_TRAJECTORY, now);
+  smov::ArbiterDecision decision = arbiter.decide(msg->state_id, now);
+  if (decision == smov::ARBITER_REJECT) {
+    warn_unknown_state(msg->state_id);
+    return;
+  }
+  if (decision == smov::ARBITER_TAKEOVER)
+    take_servos(msg->state_id);
+
+  float start[ARBITER_SERVOS];
+  for (int i = 0; i < ARBITER_SERVOS; i++)
+    start[i] = arbiter.get_output(i, now);
+
+  std::string error;
+  if (!trajectory.load(msg->interpolation == smov_states_msgs::msg::BodyTrajectory::CUBIC, msg->time_ms, msg->mask,
+                       msg->value, start, error)) {
+    RCLCPP_WARN(this->get_logger(), "Invalid trajectory from %s :: %s.", state_names[msg->state_id - 1].c_str(),
+                error.c_str());
+    trajectory_state = 0;
+    return;
   }
 
-  if (msg->state_name == robot->state) {
-    for (int i = 0; i < SERVO_MAX_SIZE; i++)
-      robot->front_prop_array.servos[i].value = msg->value[i];
-    front_prop_pub->publish(robot->front_prop_array);
+  trajectory_state = msg->state_id;
+  trajectory_start = now;
+  trajectory_timer->reset();
+}
+
+// Samples the trajectory being played and sends it to the servos, for as long as its state holds them.
+void RobotNodeHandle::trajectory_callback() {
+  std::lock_guard<std::mutex> front_lock(front_mutex);
+  std::lock_guard<std::mutex> back_lock(back_mutex);
+
+  float output[ARBITER_SERVOS];
+  {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    int64_t now = steady_now();
+
+    if ((trajectory_state == 0) || (arbiter.get_owner() != trajectory_state)) {
+      trajectory_state = 0;
+      trajectory_timer->cancel();
+      return;
+    }
+
+    // A state is alive for as long as its trajectory plays.
+    arbiter.decide(trajectory_state, now);
+    watchdog.keep_alive(trajectory_state, now);
+
+    // The servos without keyframes keep their target.
+    double time = static_cast<double>(now - trajectory_start) / 1e6;
+    for (int i = 0; i < ARBITER_SERVOS; i++)
+      output[i] = arbiter.get_target(i);
+    trajectory.sample(time, output);
+    for (int i = 0; i < ARBITER_SERVOS; i++) {
+      arbiter.set_target(i, output[i]);
+      output[i] = arbiter.get_output(i, now);
+    }
+
+    if (trajectory.is_done(time)) {
+      trajectory_state = 0;
+      trajectory_timer->cancel();
+    }
   }
+
+  write_outputs(output, 0, ARBITER_SERVOS);
+  publish_outputs(true, true);
 }
 
-void RobotNodeHandle::back_topic_callback(smov_states_msgs::msg::StatesServos::SharedPtr msg) {
-  if (robot->state == "None") {
-    robot->state = msg->state_name.c_str();
-    RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "===========================================");
-    RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Detecting a new state: %s", robot->state.c_str());
-    RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "===========================================");
+// Forwards the values a state sent for the servos [first; first + count[ of the body, front servos first, if the
+// arbiter lets it drive them.
+void RobotNodeHandle::forward_servos(uint16_t state_id, const float *values, int first, int count) {
+  bool front = first < SERVO_MAX_SIZE;
+  bool back = first + count > SERVO_MAX_SIZE;
+
+  // The mutexes of the halves are taken front first, then the state mutex.
+  std::unique_lock<std::mutex> front_lock(front_mutex, std::defer_lock);
+  std::unique_lock<std::mutex> back_lock(back_mutex, std::defer_lock);
+  if (front || use_single_board) front_lock.lock();
+  if (back && !use_single_board) back_lock.lock();
+
+  float output[ARBITER_SERVOS];
+  {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    int64_t now = steady_now();
+
+    // Every state is watched, whether it drives the servos or not.
+    smov::SourceStream stream = (count > SERVO_MAX_SIZE) ? smov::STREAM_BODY
+                                                         : (front ? smov::STREAM_FRONT : smov::STREAM_BACK);
+    watchdog.record(state_id, stream, now);
+
+    smov::ArbiterDecision decision = arbiter.decide(state_id, now);
+    if (decision == smov::ARBITER_REJECT) {
+      warn_unknown_state(state_id);
+      return;
+    }
+    if (decision == smov::ARBITER_TAKEOVER)
+      take_servos(state_id);
+
+    // Values sent directly replace the trajectory being played.
+    trajectory_state = 0;
+
+    for (int i = 0; i < count; i++)
+      arbiter.set_target(first + i, values[i]);
+    for (int i = first; i < first + count; i++)
+      output[i] = arbiter.get_output(i, now);
   }
 
-  if (msg->state_name == robot->state) {
-    if (use_single_board) {
-      for (int i = 0; i < SERVO_MAX_SIZE; i++)
-        robot->single_back_array.servos[i].value = msg->value[i];
-      front_prop_pub->publish(robot->single_back_array);
+  write_outputs(output, first, count);
+  publish_outputs(front, back);
+}
+
+// Copies the values of the servos [first; first + count[ of the body into the arrays of their board. The mutexes of
+// the halves must be held.
+void RobotNodeHandle::write_outputs(const float *output, int first, int count) {
+  for (int i = first; i < first + count; i++) {
+    if (i < SERVO_MAX_SIZE) {
+      robot->front_prop_array.servos[i].value = output[i];
+    } else if (use_single_board) {
+      robot->single_back_array.servos[i - SERVO_MAX_SIZE].value = output[i];
     } else {
-      for (int i = 0; i < SERVO_MAX_SIZE; i++)
-        robot->back_prop_array.servos[i].value = msg->value[i];
-      back_prop_pub->publish(robot->back_prop_array);
+      robot->back_prop_array.servos[i - SERVO_MAX_SIZE].value = output[i];
+    }
+    if (use_single_board)
+      robot->single_body_array.servos[i].value = output[i];
+  }
+}
+
+// Publishes the arrays of the halves. The mutexes of the halves must be held.
+void RobotNodeHandle::publish_outputs(bool front, bool back) {
+  if (use_single_board) {
+    if (front && back)
+      publish_servos(true, robot->single_body_array);
+    else
+      publish_servos(true, front ? robot->front_prop_array : robot->single_back_array);
+    return;
+  }
+  if (front)
+    publish_servos(true, robot->front_prop_array);
+  if (back)
+    publish_servos(false, robot->back_prop_array);
+}
+
+// The array is handed over as a unique pointer: when the boards run in the same process with intra-process
+// communication enabled, it reaches their callback without being serialized or copied again.
+void RobotNodeHandle::publish_servos(bool front, const smov_board_msgs::msg::ServoArray &servos) {
+  if (use_servo_frames) {
+    publish_frame(front ? front_frame_pub : back_frame_pub, servos);
+    return;
+  }
+  (front ? front_prop_pub : back_prop_pub)->publish(std::make_unique<smov_board_msgs::msg::ServoArray>(servos));
+}
+
+// The frame is borrowed from the middleware, so with a middleware able to loan messages nothing is allocated. A frame
+// holds 16 servos from the lowest one not sent yet, so servos of several boards, e.g. the back servos offset by 16 on a
+// single controller, go out as one frame per window.
+void RobotNodeHandle::publish_frame(const rclcpp::Publisher<smov_board_msgs::msg::ServoFrame>::SharedPtr &publisher,
+                                    const smov_board_msgs::msg::ServoArray &servos) {
+  int next = 1;
+  while (true) {
+    int first = 0;
+    for (auto &servo : servos.servos)
+      if ((servo.servo >= next) && ((first == 0) || (servo.servo < first)))
+        first = servo.servo;
+    if (first == 0)
+      break;
+
+    auto loaned = publisher->borrow_loaned_message();
+    smov_board_msgs::msg::ServoFrame &frame = loaned.get();
+
+    frame.first_servo = static_cast<uint16_t>(first);
+    frame.mask = 0;
+    frame.sequence = ++frame_sequence;
+    frame.stamp = this->now();
+    for (auto &servo : servos.servos) {
+      int channel = servo.servo - first;
+      if ((channel < 0) || (channel > 15))
+        continue;
+      frame.value[channel] = servo.value;
+      frame.mask |= static_cast<uint16_t>(1u << channel);
     }
+
+    publisher->publish(std::move(loaned));
+    next = first + 16;
   }
+
+  for (auto &servo : servos.servos)
+    if (servo.servo < 1)
+      RCLCPP_WARN_THROTTLE(this->get_logger(), *this->get_clock(), 5000,
+                           "Servo #%d cannot be sent in a frame :: servo numbers start at 1", servo.servo);
+}
+
+// With a single board, the back half is published on the front board from the shared body array.
+std::mutex &RobotNodeHandle::half_mutex(bool front) {
+  return (front || use_single_board) ? front_mutex : back_mutex;
+}
+
+int64_t RobotNodeHandle::steady_now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Shows the state that took the servos. The state mutex must be held.
+void RobotNodeHandle::take_servos(uint16_t state_id) {
+  robot->state_id = state_id;
+  robot->state = state_names[state_id - 1];
+  RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "===========================================");
+  RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Detecting a new state: %s", robot->state.c_str());
+  RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "===========================================");
+  publish_state();
+}
+
+// Shows that no state holds the servos anymore. The state mutex must be held.
+void RobotNodeHandle::free_servos() {
+  robot->state = "None";
+  robot->state_id = 0;
+  publish_state();
 }
 
 void RobotNodeHandle::end_state_callback(smov_states_msgs::msg::EndState::SharedPtr msg) {
-  if (msg->state_name == robot->state) {
+  std::lock_guard<std::mutex> lock(state_mutex);
+  watchdog.forget(msg->state_id);
+  if (arbiter.release(msg->state_id)) {
     RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "===========================================");
     RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "State has shutdown: %s", msg->state_name.c_str());
     RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "===========================================");
-    robot->state = "None";
+    free_servos();
   }
 }
 
+// Handles the state driving the servos missing its deadline, frees the servos of a state that stopped sending values,
+// and moves the servos along a blend.
+void RobotNodeHandle::arbitration_callback() {
+  std::lock_guard<std::mutex> front_lock(front_mutex);
+  std::lock_guard<std::mutex> back_lock(back_mutex);
+
+  float output[ARBITER_SERVOS];
+  {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    int64_t now = steady_now();
+
+    uint16_t owner = arbiter.get_owner();
+    if ((owner != 0) && watchdog.is_late(owner, now)) {
+      watchdog.count_miss(owner);
+      RCLCPP_ERROR(rclcpp::get_logger("rclcpp"), "State %s missed its %lld ms deadline :: %s.",
+                   state_names[owner - 1].c_str(),
+                   static_cast<long long>(watchdog.get_deadline(owner) / 1000000),
+                   watchdog_stops ? "stopping the servos" : "moving to the safe pose");
+      if (watchdog_stops) {
+        arbiter.release(owner);
+        stop_servos();
+      } else {
+        arbiter.hold(safe_pose, now);
+      }
+      free_servos();
+    }
+
+    uint16_t expired = arbiter.expire(now);
+    if (expired != 0) {
+      RCLCPP_WARN(rclcpp::get_logger("rclcpp"), "State %s lost the servos :: no values for %d ms.",
+                  state_names[expired - 1].c_str(), state_lease_ms);
+      free_servos();
+    }
+
+    if (!arbiter.advance_blend(now))
+      return;
+    for (int i = 0; i < ARBITER_SERVOS; i++)
+      output[i] = arbiter.get_output(i, now);
+  }
+
+  write_outputs(output, 0, ARBITER_SERVOS);
+  publish_outputs(true, true);
+}
+
+// Values from a state the manager never registered are dropped, e.g. after the manager restarted and until the state
+// registers again on the session announcement. The state mutex must be held.
+void RobotNodeHandle::warn_unknown_state(uint16_t state_id) {
+  if ((state_id != 0) && (state_id <= state_names.size()))
+    return;
+  RCLCPP_WARN_THROTTLE(this->get_logger(), *this->get_clock(), 5000,
+                       "Dropping values from unknown state ID %d :: the state must register again.", state_id);
+}
+
+// A state registering again, e.g. after a restart, gets its previous ID back.
+void RobotNodeHandle::register_state_callback(std::shared_ptr<smov_states_msgs::srv::RegisterState::Request> req,
+                                              std::shared_ptr<smov_states_msgs::srv::RegisterState::Response> res) {
+  std::lock_guard<std::mutex> lock(state_mutex);
+  auto found = std::find(state_names.begin(), state_names.end(), req->state_name);
+  if (found == state_names.end()) {
+    state_names.push_back(req->state_name);
+    found = state_names.end() - 1;
+  }
+
+  res->state_id = static_cast<uint16_t>(found - state_names.begin() + 1);
+  res->session = session;
+  arbiter.register_state(res->state_id, req->priority);
+  watchdog.register_source(res->state_id, req->deadline_ms * 1000000ll);
+  RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Registered state %s with ID %d, priority %d and deadline %d ms.",
+              req->state_name.c_str(), res->state_id, req->priority,
+              static_cast<int>(watchdog.get_deadline(res->state_id) / 1000000));
+}
+
 void RobotNodeHandle::declare_parameters() {
   std::vector<long int> default_value(5, 0);
 
@@ -115,6 +441,9 @@ void RobotNodeHandle::declare_parameters() {
   // Initializing it already to prevent a warning / error during the launch.
   use_single_board = this->get_parameter("use_single_board").as_bool();
 
+  // The boards take fixed size frames on their 'frame' topics as an alternative to ServoArray.
+  use_servo_frames = this->declare_parameter("use_servo_frames", false);
+
   // We initialize the arrays with their default values.
   for (int i = 0; i < SERVO_MAX_SIZE; i++) { // 5 is the number of data in a single array (in ~/parameters.yaml).
     robot->front_servos_data.push_back(this->get_parameter(robot->servo_name[i]).as_integer_array());
@@ -123,160 +452,341 @@ void RobotNodeHandle::declare_parameters() {
 }
 
 void RobotNodeHandle::set_up_topics() {
+  // Each half keeps its poses in order, while the two halves run side by side on the multi-threaded executor.
+  front_group = this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+  back_group = this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+  housekeeping_group = this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+
+  rclcpp::SubscriptionOptions front_options;
+  front_options.callback_group = front_group;
+  rclcpp::SubscriptionOptions back_options;
+  back_options.callback_group = back_group;
+  rclcpp::SubscriptionOptions housekeeping_options;
+  housekeeping_options.callback_group = housekeeping_group;
+
   front_states_sub = this->create_subscription<smov_states_msgs::msg::StatesServos>(
-      "front_proportional_servos", 1, std::bind(&RobotNodeHandle::front_topic_callback, this, std::placeholders::_1));
+      "front_proportional_servos", 1, std::bind(&RobotNodeHandle::front_topic_callback, this, std::placeholders::_1),
+      front_options);
 
   back_states_sub = this->create_subscription<smov_states_msgs::msg::StatesServos>(
-      "back_proportional_servos", 1, std::bind(&RobotNodeHandle::back_topic_callback, this, std::placeholders::_1));
+      "back_proportional_servos", 1, std::bind(&RobotNodeHandle::back_topic_callback, this, std::placeholders::_1),
+      back_options);
+
+  body_states_sub = this->create_subscription<smov_states_msgs::msg::BodyServos>(
+      "body_proportional_servos", 1, std::bind(&RobotNodeHandle::body_topic_callback, this, std::placeholders::_1),
+      front_options);
+
+  // Trajectories are only stored when received, the trajectory timer sends them to the servos.
+  body_trajectory_sub = this->create_subscription<smov_states_msgs::msg::BodyTrajectory>(
+      "body_trajectory", 10, std::bind(&RobotNodeHandle::trajectory_topic_callback, this, std::placeholders::_1),
+      housekeeping_options);
 
   RCLCPP_INFO(this->get_logger(), "Set up states subscribers.");
 
   // Setting up the servo config client.
-  front_servo_config_client = this->create_client<smov_board_msgs::srv::ServosConfig>("front_config_servos");
+  front_servo_config_client = this->create_client<smov_board_msgs::srv::ServosConfig>(
+      "front_config_servos", rmw_qos_profile_services_default, housekeeping_group);
   if (!use_single_board)
-    back_servo_config_client = this->create_client<smov_board_msgs::srv::ServosConfig>("back_config_servos");
+    back_servo_config_client = this->create_client<smov_board_msgs::srv::ServosConfig>(
+        "back_config_servos", rmw_qos_profile_services_default, housekeeping_group);
 
-  front_stop_servos_client = this->create_client<std_srvs::srv::Empty>("front_stop_servos");
-  if (!use_single_board) back_stop_servos_client = this->create_client<std_srvs::srv::Empty>("back_stop_servos");
+  front_stop_servos_client = this->create_client<std_srvs::srv::Empty>(
+      "front_stop_servos", rmw_qos_profile_services_default, housekeeping_group);
+  if (!use_single_board)
+    back_stop_servos_client = this->create_client<std_srvs::srv::Empty>(
+        "back_stop_servos", rmw_qos_profile_services_default, housekeeping_group);
 
   RCLCPP_INFO(this->get_logger(), "Set up /config_servos_handler publisher.");
 
   end_state_sub = this->create_subscription<smov_states_msgs::msg::EndState>(
-      "end_state", 1, std::bind(&RobotNodeHandle::end_state_callback, this, std::placeholders::_1));
+      "end_state", 1, std::bind(&RobotNodeHandle::end_state_callback, this, std::placeholders::_1),
+      housekeeping_options);
 
   RCLCPP_INFO(this->get_logger(), "Set up /end_state subscriber.");
 
+  register_state_srv = this->create_service<smov_states_msgs::srv::RegisterState>(
+      "register_state", std::bind(&RobotNodeHandle::register_state_callback, this, std::placeholders::_1,
+                                  std::placeholders::_2),
+      rmw_qos_profile_services_default, housekeeping_group);
+
+  RCLCPP_INFO(this->get_logger(), "Set up /register_state service.");
+
+  // The states registered with a previous run of the manager register again when they see another session. It is
+  // kept for the states started later, which compare it with the session they registered with.
+  session = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count());
+  session_pub = this->create_publisher<std_msgs::msg::UInt64>("states_manager_session",
+                                                              rclcpp::QoS(1).transient_local());
+  std_msgs::msg::UInt64 session_msg;
+  session_msg.data = session;
+  session_pub->publish(session_msg);
+
   front_prop_pub = this->create_publisher<smov_board_msgs::msg::ServoArray>("front_servos_proportional", 100);
   if (!use_single_board)
     back_prop_pub = this->create_publisher<smov_board_msgs::msg::ServoArray>("back_servos_proportional", 100);
 
   RCLCPP_INFO(this->get_logger(), "Set up /servos_proportional_handler publisher.");
 
+  front_frame_pub = this->create_publisher<smov_board_msgs::msg::ServoFrame>("front_servos_frame", 100);
+  if (!use_single_board)
+    back_frame_pub = this->create_publisher<smov_board_msgs::msg::ServoFrame>("back_servos_frame", 100);
+
   // Setting up the absolute publishers.
   front_abs_pub = this->create_publisher<smov_board_msgs::msg::ServoArray>("front_servos_absolute", 100);
   if (!use_single_board)
     back_abs_pub = this->create_publisher<smov_board_msgs::msg::ServoArray>("back_servos_absolute", 100);
 
   // Setting up the monitor publisher.
-  monitor_pub = this->create_publisher<smov_monitor_msgs::msg::DisplayText>("data_display", 1);
+  // The panel keeps the last state, so a monitor started later still gets it.
+  monitor_pub = this->create_publisher<smov_monitor_msgs::msg::DisplayText>("data_display",
+                                                                            rclcpp::QoS(1).transient_local());
 
   RCLCPP_INFO(this->get_logger(), "Set up /servos_absolute_handler publisher.");
 }
 
-void RobotNodeHandle::config_servos() {
-  smov_board_msgs::msg::ServoConfig front_config[SERVO_MAX_SIZE * 2];
-  smov_board_msgs::msg::ServoConfig back_config[SERVO_MAX_SIZE];
+smov_board_msgs::msg::ServoConfig RobotNodeHandle::make_servo_config(const std::vector<long int> &data) {
+  smov_board_msgs::msg::ServoConfig config;
+  config.servo = static_cast<int16_t>(data[0] + 1);
+  config.center = static_cast<int16_t>(data[1]);
+  config.range = static_cast<int16_t>(data[2]);
+  config.direction = static_cast<int16_t>(data[3]);
+  return config;
+}
 
+void RobotNodeHandle::config_servos() {
   auto front_request = std::make_shared<smov_board_msgs::srv::ServosConfig::Request>();
   auto back_request = std::make_shared<smov_board_msgs::srv::ServosConfig::Request>();
 
   for (int h = 0; h < SERVO_MAX_SIZE; h++) {
-    front_config[h].servo = static_cast<int16_t>(robot->front_servos_data[h][0] + 1);
-    front_config[h].direction = static_cast<int16_t>(robot->front_servos_data[h][3]);
-    front_config[h].center = static_cast<int16_t>(robot->front_servos_data[h][1]);
-    front_config[h].range = static_cast<int16_t>(robot->front_servos_data[h][2]);
-    front_request->servos.push_back(front_config[h]);
-
-    if (use_single_board) {
-      front_config[h + SERVO_MAX_SIZE].range = static_cast<int16_t>(robot->back_servos_data[h][2]);
-      front_config[h + SERVO_MAX_SIZE].direction = static_cast<int16_t>(robot->back_servos_data[h][3]);
-      front_config[h + SERVO_MAX_SIZE].center = static_cast<int16_t>(robot->back_servos_data[h][1]);
-      front_config[h + SERVO_MAX_SIZE].servo = static_cast<int16_t>(robot->back_servos_data[h][0] + 1);
-      front_request->servos.push_back(front_config[h + SERVO_MAX_SIZE]);
+    front_request->servos.push_back(make_servo_config(robot->front_servos_data[h]));
+    (use_single_board ? front_request : back_request)->servos.push_back(make_servo_config(robot->back_servos_data[h]));
+  }
+
+  front_config_request = front_request;
+  if (!use_single_board)
+    back_config_request = back_request;
+
+  // The executor is not spinning yet, so the requests are sent as soon as the boards are up instead of waiting here.
+  config_timer = this->create_wall_timer(std::chrono::seconds(1),
+                                         std::bind(&RobotNodeHandle::send_config_requests, this),
+                                         housekeeping_group);
+  send_config_requests();
+}
+
+// Sends each pending calibration once the service of its board is available.
+void RobotNodeHandle::send_config_requests() {
+  using ServosConfigFuture = rclcpp::Client<smov_board_msgs::srv::ServosConfig>::SharedFuture;
+
+  if (front_config_request) {
+    if (front_servo_config_client->service_is_ready()) {
+      front_servo_config_client->async_send_request(front_config_request,
+                                                    [this](ServosConfigFuture) { servos_configured(true); });
+      front_config_request = nullptr;
     } else {
-      back_config[h].range = static_cast<int16_t>(robot->back_servos_data[h][2]);
-      back_config[h].direction = static_cast<int16_t>(robot->back_servos_data[h][3]);
-      back_config[h].center = static_cast<int16_t>(robot->back_servos_data[h][1]);
-      back_config[h].servo = static_cast<int16_t>(robot->back_servos_data[h][0] + 1);
-      back_request->servos.push_back(back_config[h]);
+      RCLCPP_INFO(this->get_logger(), "Front Config Servos service not available, waiting again...");
     }
   }
+  if (back_config_request) {
+    if (back_servo_config_client->service_is_ready()) {
+      back_servo_config_client->async_send_request(back_config_request,
+                                                   [this](ServosConfigFuture) { servos_configured(false); });
+      back_config_request = nullptr;
+    } else {
+      RCLCPP_INFO(this->get_logger(), "Back Config Servos service not available, waiting again...");
+    }
+  }
+
+  if (!front_config_request && !back_config_request)
+    config_timer->cancel();
+}
 
-  while (!front_servo_config_client->wait_for_service(std::chrono::seconds(1))) {
-    if (!rclcpp::ok()) {
-      RCLCPP_ERROR(this->get_logger(), "Interrupted while waiting for the service. Exiting.");
+// Once a board applied its calibration, its servos are locked at their initial value unless a state took them first.
+void RobotNodeHandle::servos_configured(bool front) {
+  RCLCPP_INFO(this->get_logger(), "%s servos have been configured.", front ? "Front" : "Back");
+
+  {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    if (arbiter.get_owner() != 0)
       return;
+  }
+
+  std::lock_guard<std::mutex> lock(half_mutex(front));
+  if (use_single_board)
+    publish_servos(true, robot->single_body_array);
+  else
+    publish_servos(front, front ? robot->front_prop_array : robot->back_prop_array);
+}
+
+/**
+ * Called before servo parameters are set, e.g. by 'ros2 param set'.
+ *
+ * Only the servos whose port, center, range or direction actually changed are sent to their board, in one request per
+ * board. The board swaps its whole servo table at once, between two frames. A new port takes effect on the next
+ * published frame.
+ */
+rcl_interfaces::msg::SetParametersResult RobotNodeHandle::calibration_callback(
+    const std::vector<rclcpp::Parameter> &parameters) {
+  rcl_interfaces::msg::SetParametersResult result;
+  result.successful = true;
+
+  for (const auto &parameter : parameters) {
+    if (std::find(robot->servo_name.begin(), robot->servo_name.end(), parameter.get_name()) == robot->servo_name.end())
+      continue;
+    if ((parameter.get_type() != rclcpp::ParameterType::PARAMETER_INTEGER_ARRAY)
+        || (parameter.as_integer_array().size() < 5)) {
+      result.successful = false;
+      result.reason = parameter.get_name() + " must be an array of 5 integers: port, center, range, direction, value";
+      return result;
     }
-    RCLCPP_INFO(this->get_logger(), "Front Config Servos service not available, waiting again...");
   }
-  if (!use_single_board) {
-    while (!back_servo_config_client->wait_for_service(std::chrono::seconds(1))) {
-      if (!rclcpp::ok()) {
-        RCLCPP_ERROR(this->get_logger(), "Interrupted while waiting for the service. Exiting.");
-        return;
+
+  auto front_request = std::make_shared<smov_board_msgs::srv::ServosConfig::Request>();
+  auto back_request = std::make_shared<smov_board_msgs::srv::ServosConfig::Request>();
+
+  // The servo numbers of both halves may change, the front mutex is always taken first.
+  std::lock_guard<std::mutex> front_lock(front_mutex);
+  std::lock_guard<std::mutex> back_lock(back_mutex);
+
+  for (const auto &parameter : parameters) {
+    auto name = std::find(robot->servo_name.begin(), robot->servo_name.end(), parameter.get_name());
+    if (name == robot->servo_name.end())
+      continue;
+
+    auto index = static_cast<int>(name - robot->servo_name.begin());
+    bool front = index < SERVO_MAX_SIZE;
+    int servo = index % SERVO_MAX_SIZE;
+    std::vector<long int> &data = front ? robot->front_servos_data[servo] : robot->back_servos_data[servo];
+
+    auto values = parameter.as_integer_array();
+    std::vector<long int> updated(values.begin(), values.end());
+    if (std::equal(updated.begin(), updated.begin() + 4, data.begin()))
+      continue;
+    data = updated;
+
+    smov_board_msgs::msg::ServoConfig config = make_servo_config(data);
+    if (front) {
+      robot->front_prop_array.servos[servo].servo = config.servo;
+      robot->front_abs_array.servos[servo].servo = config.servo;
+      if (use_single_board) robot->single_body_array.servos[servo].servo = config.servo;
+    } else {
+      robot->back_prop_array.servos[servo].servo = config.servo;
+      robot->back_abs_array.servos[servo].servo = config.servo;
+      if (use_single_board) {
+        robot->single_back_array.servos[servo].servo = config.servo;
+        robot->single_body_array.servos[servo + SERVO_MAX_SIZE].servo = config.servo;
       }
-      RCLCPP_INFO(this->get_logger(), "Back Config Servos service not available, waiting again...");
     }
+    ((front || use_single_board) ? front_request : back_request)->servos.push_back(config);
+
+    RCLCPP_INFO(this->get_logger(), "Recalibrating %s: port=%ld, center=%ld, range=%ld, direction=%ld.",
+                parameter.get_name().c_str(), data[0], data[1], data[2], data[3]);
   }
 
-  auto f_result = front_servo_config_client->async_send_request(front_request);
-  if (!use_single_board) auto b_result = back_servo_config_client->async_send_request(back_request);
+  if (!front_request->servos.empty()) {
+    if (front_servo_config_client->service_is_ready())
+      front_servo_config_client->async_send_request(front_request);
+    else
+      RCLCPP_WARN(this->get_logger(), "Front Config Servos service not available, calibration not sent.");
+  }
+  if (!back_request->servos.empty()) {
+    if (back_servo_config_client->service_is_ready())
+      back_servo_config_client->async_send_request(back_request);
+    else
+      RCLCPP_WARN(this->get_logger(), "Back Config Servos service not available, calibration not sent.");
+  }
 
-  RCLCPP_INFO(this->get_logger(), "Servos have been configured.");
+  return result;
 }
 
+// The boards are asked to stop their servos without waiting for the answer.
 void RobotNodeHandle::stop_servos() {
   auto req = std::make_shared<std_srvs::srv::Empty::Request>();
 
-  while (!front_stop_servos_client->wait_for_service(std::chrono::seconds(1))) {
-    if (!rclcpp::ok()) {
-      RCLCPP_ERROR(this->get_logger(), "Interrupted while waiting for the service. Exiting.");
-      return;
-    }
-    RCLCPP_INFO(this->get_logger(), "Front Stop Servos service not available, waiting again...");
-  }
-  while (!back_stop_servos_client->wait_for_service(std::chrono::seconds(1))) {
-    if (!rclcpp::ok()) {
-      RCLCPP_ERROR(this->get_logger(), "Interrupted while waiting for the service. Exiting.");
-      return;
-    }
-    RCLCPP_INFO(this->get_logger(), "Back Stop Servos service not available, waiting again...");
+  if (front_stop_servos_client->service_is_ready())
+    front_stop_servos_client->async_send_request(req);
+  else
+    RCLCPP_WARN(this->get_logger(), "Front Stop Servos service not available, servos not stopped.");
+
+  if (!use_single_board) {
+    if (back_stop_servos_client->service_is_ready())
+      back_stop_servos_client->async_send_request(req);
+    else
+      RCLCPP_WARN(this->get_logger(), "Back Stop Servos service not available, servos not stopped.");
   }
+}
 
-  auto f_result = front_stop_servos_client->async_send_request(req);
-  if (!use_single_board) auto b_result = back_stop_servos_client->async_send_request(req);
+// Showing the current state on the panel. The state mutex must be held.
+void RobotNodeHandle::publish_state() {
+  up_display.data = std::string("Current state: ") + robot->state;
+  monitor_pub->publish(up_display);
 }
 
-void RobotNodeHandle::late_callback() {
-  for (int b = 0; b < SERVO_MAX_SIZE; b++) {
-    RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Front Servo Array Servo %d [value=%f].",
-                robot->front_prop_array.servos[b].servo, robot->front_prop_array.servos[b].value);
-    if (b == SERVO_MAX_SIZE - 1) {
-      RCLCPP_INFO(rclcpp::get_logger("rclcpp"),
-                  "-------------------------------------------");
-      for (int a = 0; a < SERVO_MAX_SIZE; a++) {
-        if (use_single_board) {
-          RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Back Servo Array Servo %d [value=%f].",
-                      robot->single_back_array.servos[a].servo, robot->single_back_array.servos[a].value);
-        } else {
-          RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Back Servo Array Servo %d [value=%f].",
-                      robot->back_prop_array.servos[a].servo, robot->back_prop_array.servos[a].value);
-        }
-        if (a == SERVO_MAX_SIZE - 1) {
-          RCLCPP_INFO(rclcpp::get_logger("rclcpp"),
-                      "-------------------------------------------");
-          RCLCPP_INFO(rclcpp::get_logger("rclcpp"), "Current State: %s", robot->state.c_str());
-          RCLCPP_INFO(rclcpp::get_logger("rclcpp"),
-                      "-------------------------------------------");
-        }
+// The values last sent to the servos, the current state and how the states keep up, for tools such as
+// rqt_runtime_monitor. The level turns to WARN once a state missed its deadline.
+void RobotNodeHandle::publish_diagnostics() {
+  static const char *stream_names[smov::STREAM_COUNT] = {"front", "back", "body", "trajectory"};
+
+  diagnostic_msgs::msg::DiagnosticStatus status;
+  status.name = std::string(this->get_name()) + ": servos";
+  status.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+
+  diagnostic_msgs::msg::KeyValue key_value;
+  {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    int64_t now = steady_now();
+    status.message = "Current state: " + robot->state;
+
+    key_value.key = "state";
+    key_value.value = robot->state;
+    status.values.push_back(key_value);
+
+    // Age of the values driving the servos, in ms.
+    int64_t age = watchdog.get_age(arbiter.get_owner(), now);
+    key_value.key = "owner_age_ms";
+    key_value.value = age < 0 ? "-" : std::to_string(static_cast<double>(age) / 1e6);
+    status.values.push_back(key_value);
+
+    for (uint16_t source = 1; source < watchdog.get_source_count(); source++) {
+      const std::string &name = state_names[source - 1];
+      for (int stream = 0; stream < smov::STREAM_COUNT; stream++) {
+        const smov::StreamStats &stats = watchdog.get_stats(source, static_cast<smov::SourceStream>(stream));
+        if (stats.count == 0)
+          continue;
+        key_value.key = name + "_" + stream_names[stream] + "_interval_ms";
+        key_value.value = stats.to_string();
+        status.values.push_back(key_value);
+      }
+
+      uint64_t misses = watchdog.get_misses(source);
+      if (misses != 0) {
+        key_value.key = name + "_deadline_misses";
+        key_value.value = std::to_string(misses);
+        status.values.push_back(key_value);
+        status.level = diagnostic_msgs::msg::DiagnosticStatus::WARN;
       }
     }
   }
 
-  // For now, we are basically nesting loops, cool right...
+  std::lock_guard<std::mutex> front_lock(front_mutex);
+  std::lock_guard<std::mutex> back_lock(back_mutex);
+  const smov_board_msgs::msg::ServoArray &back = use_single_board ? robot->single_back_array : robot->back_prop_array;
   for (int i = 0; i < SERVO_MAX_SIZE; i++) {
-    robot->front_servos_data[i] = this->get_parameter(robot->servo_name[i]).as_integer_array();
-    robot->back_servos_data[i] = this->get_parameter(robot->servo_name[i + SERVO_MAX_SIZE]).as_integer_array();
+    key_value.key = "front_servo_" + std::to_string(robot->front_prop_array.servos[i].servo);
+    key_value.value = std::to_string(robot->front_prop_array.servos[i].value);
+    status.values.push_back(key_value);
+  }
+  for (int i = 0; i < SERVO_MAX_SIZE; i++) {
+    key_value.key = "back_servo_" + std::to_string(back.servos[i].servo);
+    key_value.value = std::to_string(back.servos[i].value);
+    status.values.push_back(key_value);
   }
 
-  use_single_board = this->get_parameter("use_single_board").as_bool();
-
-
-  // Making sure we are on the desired state.
-  up_display.data = std::string("Current state: ") + robot->state;
-
-  // Publishing to the panel.
-  monitor_pub->publish(up_display);
+  diagnostic_msgs::msg::DiagnosticArray array;
+  array.header.stamp = this->now();
+  array.status.push_back(status);
+  diagnostics_pub->publish(array);
 }
 
 } // namespace smov
+
+RCLCPP_COMPONENTS_REGISTER_NODE(smov::RobotNodeHandle)
@@ -1 +1,97 @@
+#include <stdexcept>
+
 #include <states/robot_states.h>
+
+namespace smov {
+
+uint16_t register_state(rclcpp::Node *node, const std::string &state_name, uint8_t priority,
+                        uint16_t deadline_ms, uint64_t *session) {
+  auto client = node->create_client<smov_states_msgs::srv::RegisterState>("register_state");
+
+  auto request = std::make_shared<smov_states_msgs::srv::RegisterState::Request>();
+  request->state_name = state_name;
+  request->priority = priority;
+  request->deadline_ms = deadline_ms;
+
+  // A state without an ID would have all of its values rejected by the manager, so it keeps asking for one.
+  while (true) {
+    while (!client->wait_for_service(std::chrono::seconds(1))) {
+      if (!rclcpp::ok())
+        throw std::runtime_error("Interrupted while waiting for the Register State service.");
+      RCLCPP_INFO(node->get_logger(), "Register State service not available, waiting again...");
+    }
+
+    auto result = client->async_send_request(request);
+    if (rclcpp::spin_until_future_complete(node->get_node_base_interface(), result, std::chrono::seconds(1))
+        == rclcpp::FutureReturnCode::SUCCESS) {
+      auto response = result.get();
+      if (response->state_id != 0) {
+        if (session != nullptr)
+          *session = response->session;
+        RCLCPP_INFO(node->get_logger(), "State %s registered with ID %d.", state_name.c_str(), response->state_id);
+        return response->state_id;
+      }
+    }
+
+    if (!rclcpp::ok())
+      throw std::runtime_error("Interrupted while registering the state " + state_name + ".");
+    RCLCPP_WARN(node->get_logger(), "Unable to register the state %s, trying again...", state_name.c_str());
+  }
+}
+
+StateRegistration::StateRegistration(rclcpp::Node *node,
+                                     const std::string &state_name,
+                                     uint8_t priority,
+                                     uint16_t deadline_ms,
+                                     std::function<void(uint16_t)> set_id)
+    : node(node), set_id(std::move(set_id)), session(0) {
+  this->set_id(register_state(node, state_name, priority, deadline_ms, &session));
+
+  request = std::make_shared<smov_states_msgs::srv::RegisterState::Request>();
+  request->state_name = state_name;
+  request->priority = priority;
+  request->deadline_ms = deadline_ms;
+  client = node->create_client<smov_states_msgs::srv::RegisterState>("register_state");
+
+  retry_timer = node->create_wall_timer(std::chrono::seconds(1), std::bind(&StateRegistration::send_request, this));
+  retry_timer->cancel();
+
+  // The manager keeps announcing its session, so the state learns about a restart whenever it happens.
+  session_sub = node->create_subscription<std_msgs::msg::UInt64>(
+      "states_manager_session", rclcpp::QoS(1).transient_local(),
+      std::bind(&StateRegistration::session_callback, this, std::placeholders::_1));
+}
+
+// Another manager does not know the ID of the state, which may even belong to another state there: the state stops
+// sending values under it until it registered again.
+void StateRegistration::session_callback(std_msgs::msg::UInt64::SharedPtr msg) {
+  if (msg->data == session)
+    return;
+
+  RCLCPP_WARN(node->get_logger(), "The states manager restarted, registering the state %s again.",
+              request->state_name.c_str());
+  set_id(0);
+  retry_timer->reset();
+  send_request();
+}
+
+// Called from the executor of the node, the request is sent again each second until the manager answers.
+void StateRegistration::send_request() {
+  if (!client->service_is_ready())
+    return;
+
+  client->async_send_request(
+      request, [this](rclcpp::Client<smov_states_msgs::srv::RegisterState>::SharedFuture future) {
+        auto response = future.get();
+        if ((response->state_id == 0) || (response->session == session))
+          return;
+
+        session = response->session;
+        retry_timer->cancel();
+        set_id(response->state_id);
+        RCLCPP_INFO(node->get_logger(), "State %s registered again with ID %d.", request->state_name.c_str(),
+                    response->state_id);
+      });
+}
+
+} // namespace smov
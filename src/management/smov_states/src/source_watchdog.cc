@@ -0,0 +1,118 @@
+#include <cmath>
+#include <cstdio>
+
+#include <states/source_watchdog.h>
+
+namespace smov {
+
+// Intervals are shown in milliseconds.
+std::string StreamStats::to_string() const {
+  double stddev = count > 2 ? std::sqrt(m2 / static_cast<double>(count - 2)) : 0.0;
+  char text[128];
+  snprintf(text, sizeof(text), "n=%llu mean=%.1f stddev=%.1f jitter<=%.1f max=%.1f",
+           static_cast<unsigned long long>(count), mean / 1e6, stddev / 1e6, max_jitter / 1e6,
+           static_cast<double>(max) / 1e6);
+  return text;
+}
+
+SourceWatchdog::SourceWatchdog()
+    : default_deadline(0), deadlines(1, 0), last_values(1, 0), misses(1, 0), stats(STREAM_COUNT) {}
+
+// A deadline of 0 disables the watchdog for the sources without one of their own.
+void SourceWatchdog::configure(int64_t deadline) {
+  default_deadline = deadline;
+}
+
+// Registering a source again updates its deadline, 0 using the default one.
+void SourceWatchdog::register_source(uint16_t source, int64_t deadline) {
+  if (source == 0)
+    return;
+  if (source >= deadlines.size()) {
+    deadlines.resize(source + 1, 0);
+    last_values.resize(source + 1, 0);
+    misses.resize(source + 1, 0);
+    stats.resize((source + 1) * STREAM_COUNT);
+  }
+  deadlines[source] = deadline;
+}
+
+// Welford's update keeps the mean and the variance of the intervals without storing them.
+void SourceWatchdog::record(uint16_t source, SourceStream stream, int64_t now) {
+  if ((source == 0) || (source >= deadlines.size()))
+    return;
+
+  last_values[source] = now;
+
+  StreamStats &stream_stats = stats[source * STREAM_COUNT + stream];
+  if (stream_stats.last != 0) {
+    int64_t interval = now - stream_stats.last;
+    auto samples = static_cast<double>(stream_stats.count);  // The first message has no interval.
+    double delta = static_cast<double>(interval) - stream_stats.mean;
+    stream_stats.mean += delta / samples;
+    stream_stats.m2 += delta * (static_cast<double>(interval) - stream_stats.mean);
+    if (interval > stream_stats.max)
+      stream_stats.max = interval;
+    double jitter = std::fabs(static_cast<double>(interval) - stream_stats.mean);
+    if ((samples > 1) && (jitter > stream_stats.max_jitter))
+      stream_stats.max_jitter = jitter;
+  }
+  stream_stats.last = now;
+  stream_stats.count++;
+}
+
+// Counts as fresh values of a source without touching its statistics, e.g. while the manager plays its trajectory.
+void SourceWatchdog::keep_alive(uint16_t source, int64_t now) {
+  if ((source != 0) && (source < deadlines.size()))
+    last_values[source] = now;
+}
+
+// A source that ended is not late anymore. Its statistics start over, as the time until it sends values again is not
+// an interval, and its missed deadlines are kept.
+void SourceWatchdog::forget(uint16_t source) {
+  if ((source == 0) || (source >= deadlines.size()))
+    return;
+
+  last_values[source] = 0;
+  for (int stream = 0; stream < STREAM_COUNT; stream++)
+    stats[source * STREAM_COUNT + stream] = StreamStats();
+}
+
+bool SourceWatchdog::is_late(uint16_t source, int64_t now) const {
+  int64_t deadline = get_deadline(source);
+  if ((deadline <= 0) || (last_values[source] == 0))
+    return false;
+  return now - last_values[source] > deadline;
+}
+
+// Age of the last values of a source, -1 if it has none.
+int64_t SourceWatchdog::get_age(uint16_t source, int64_t now) const {
+  if ((source == 0) || (source >= deadlines.size()) || (last_values[source] == 0))
+    return -1;
+  return now - last_values[source];
+}
+
+int64_t SourceWatchdog::get_deadline(uint16_t source) const {
+  if ((source == 0) || (source >= deadlines.size()))
+    return 0;
+  return deadlines[source] > 0 ? deadlines[source] : default_deadline;
+}
+
+const StreamStats &SourceWatchdog::get_stats(uint16_t source, SourceStream stream) const {
+  return stats[source * STREAM_COUNT + stream];
+}
+
+uint64_t SourceWatchdog::get_misses(uint16_t source) const {
+  return misses[source];
+}
+
+void SourceWatchdog::count_miss(uint16_t source) {
+  if ((source != 0) && (source < deadlines.size()))
+    misses[source]++;
+}
+
+// Sources are numbered 1..get_source_count() - 1.
+uint16_t SourceWatchdog::get_source_count() const {
+  return static_cast<uint16_t>(deadlines.size());
+}
+
+} // namespace smov
@@ -0,0 +1,153 @@
+#include <states/state_arbiter.h>
+
+namespace smov {
+
+StateArbiter::StateArbiter()
+    : lease_ns(0), blend_ns(0), owner(0), priorities(1, 0), last_seen(1, 0), preempt_table(1, 0), blend_start(0),
+      blend_end(0), blending(false) {}
+
+// A lease or a blend time of 0 disables it.
+void StateArbiter::configure(int64_t lease, int64_t blend) {
+  lease_ns = lease;
+  blend_ns = blend;
+}
+
+// Registering a state again updates its priority.
+void StateArbiter::register_state(uint16_t state_id, uint8_t priority) {
+  if (state_id == 0)
+    return;
+  if (state_id >= priorities.size()) {
+    priorities.resize(state_id + 1, 0);
+    last_seen.resize(state_id + 1, 0);
+  }
+  priorities[state_id] = priority;
+
+  size_t count = priorities.size();
+  preempt_table.assign(count * count, 0);
+  for (size_t a = 1; a < count; a++)
+    for (size_t b = 1; b < count; b++)
+      preempt_table[a * count + b] = priorities[a] > priorities[b] ? 1 : 0;
+}
+
+ArbiterDecision StateArbiter::decide(uint16_t state_id, int64_t now) {
+  if ((state_id == 0) || (state_id >= priorities.size()))
+    return ARBITER_REJECT;
+
+  last_seen[state_id] = now;
+  if (state_id == owner)
+    return ARBITER_ACCEPT;
+
+  if ((owner != 0) && is_live(owner, now) && !preempts(state_id, owner))
+    return ARBITER_REJECT;
+
+  // A free robot waits for a live state with a higher priority to send its next values.
+  if ((owner == 0) || !is_live(owner, now)) {
+    for (uint16_t other = 1; other < priorities.size(); other++)
+      if ((other != state_id) && is_live(other, now) && preempts(other, state_id))
+        return ARBITER_REJECT;
+  }
+
+  take(state_id, now);
+  return ARBITER_TAKEOVER;
+}
+
+// Returns true if the state held the servos.
+bool StateArbiter::release(uint16_t state_id) {
+  if ((state_id == 0) || (state_id >= priorities.size()))
+    return false;
+
+  last_seen[state_id] = 0;
+  if (state_id != owner)
+    return false;
+  owner = 0;
+  return true;
+}
+
+// Frees the servos if their owner stopped sending values for longer than its lease, returning its ID.
+uint16_t StateArbiter::expire(int64_t now) {
+  if ((owner == 0) || is_live(owner, now))
+    return 0;
+
+  uint16_t expired = owner;
+  release(expired);
+  return expired;
+}
+
+// Frees the servos and moves them to a pose of their own, e.g. a safe pose when their owner stalled. The pose is
+// reached over the blend time.
+void StateArbiter::hold(const float *pose, int64_t now) {
+  release(owner);
+  for (int servo = 0; servo < ARBITER_SERVOS; servo++) {
+    blend_from[servo] = output[servo];
+    target[servo] = pose[servo];
+  }
+  start_blend(now);
+  blending = true; // Without a blend time, the pose is still sent once.
+}
+
+void StateArbiter::set_target(int servo, float value) {
+  target[servo] = value;
+}
+
+float StateArbiter::get_target(int servo) const {
+  return target[servo];
+}
+
+// Sets where the servos are before any state took them.
+void StateArbiter::set_output(int servo, float value) {
+  output[servo] = value;
+  target[servo] = value;
+}
+
+// The value to send to a servo, on its way from the previous owner to the current one while blending.
+float StateArbiter::get_output(int servo, int64_t now) {
+  if (now >= blend_end) {
+    output[servo] = target[servo];
+  } else {
+    float progress = static_cast<float>(now - blend_start) / static_cast<float>(blend_ns);
+    output[servo] = blend_from[servo] + (target[servo] - blend_from[servo]) * progress;
+  }
+  return output[servo];
+}
+
+// Returns true while a blend is in progress, including the call that completes it.
+bool StateArbiter::advance_blend(int64_t now) {
+  if (!blending)
+    return false;
+  if (now >= blend_end)
+    blending = false;
+  return true;
+}
+
+uint16_t StateArbiter::get_owner() const {
+  return owner;
+}
+
+// Without a lease, a state stays live until it ends.
+bool StateArbiter::is_live(uint16_t state_id, int64_t now) const {
+  if (last_seen[state_id] == 0)
+    return false;
+  return (lease_ns <= 0) || (now - last_seen[state_id] <= lease_ns);
+}
+
+bool StateArbiter::preempts(uint16_t state_id, uint16_t other) const {
+  return preempt_table[state_id * priorities.size() + other] != 0;
+}
+
+// The servos the new owner does not drive hold where the previous one left them.
+void StateArbiter::take(uint16_t state_id, int64_t now) {
+  owner = state_id;
+  for (int servo = 0; servo < ARBITER_SERVOS; servo++) {
+    blend_from[servo] = output[servo];
+    target[servo] = output[servo];
+  }
+  start_blend(now);
+}
+
+void StateArbiter::start_blend(int64_t now) {
+  blend_start = now;
+  blend_end = now + (blend_ns > 0 ? blend_ns : 0);
+  blending = blend_ns > 0;
+}
+
+} // namespace smov
@@ -0,0 +1,107 @@
+#include <algorithm>
+
+#include <states/trajectory.h>
+
+namespace smov {
+
+Trajectory::Trajectory() : cubic(false), duration(0.0) {}
+
+// Loads keyframes of 12 values each, an empty mask setting every servo. Returns false with the reason if the keyframes
+// are not consistent, leaving the trajectory empty.
+bool Trajectory::load(bool use_cubic,
+                      const std::vector<uint32_t> &times,
+                      const std::vector<uint16_t> &masks,
+                      const std::vector<float> &values,
+                      const float *start,
+                      std::string &error) {
+  for (auto &keyframes : servos) {
+    keyframes.times.clear();
+    keyframes.values.clear();
+  }
+  duration = 0.0;
+  cubic = use_cubic;
+
+  size_t count = times.size();
+  if (count == 0) {
+    error = "no keyframes";
+    return false;
+  }
+  if (values.size() != count * ARBITER_SERVOS) {
+    error = "expected " + std::to_string(count * ARBITER_SERVOS) + " values for " + std::to_string(count)
+        + " keyframes, got " + std::to_string(values.size());
+    return false;
+  }
+  if (!masks.empty() && (masks.size() != count)) {
+    error = "expected one mask per keyframe or none";
+    return false;
+  }
+  for (size_t i = 1; i < count; i++) {
+    if (times[i] <= times[i - 1]) {
+      error = "keyframe times must be increasing";
+      return false;
+    }
+  }
+
+  // Each servo starts from its current value, unless its first keyframe is at the very start.
+  for (int servo = 0; servo < ARBITER_SERVOS; servo++) {
+    Keyframes &keyframes = servos[servo];
+    for (size_t i = 0; i < count; i++) {
+      if (!masks.empty() && ((masks[i] & (1u << servo)) == 0))
+        continue;
+      if (keyframes.times.empty() && (times[i] > 0)) {
+        keyframes.times.push_back(0.0);
+        keyframes.values.push_back(start[servo]);
+      }
+      keyframes.times.push_back(static_cast<double>(times[i]));
+      keyframes.values.push_back(values[i * ARBITER_SERVOS + servo]);
+    }
+  }
+
+  duration = static_cast<double>(times.back());
+  return true;
+}
+
+// Writes the value of every servo with keyframes at a time, the other servos are left as they are.
+void Trajectory::sample(double time, float *output) const {
+  for (int servo = 0; servo < ARBITER_SERVOS; servo++)
+    if (!servos[servo].times.empty())
+      output[servo] = sample_servo(servos[servo], time);
+}
+
+bool Trajectory::is_done(double time) const {
+  return time >= duration;
+}
+
+double Trajectory::get_duration() const {
+  return duration;
+}
+
+float Trajectory::sample_servo(const Keyframes &keyframes, double time) const {
+  const std::vector<double> &t = keyframes.times;
+  const std::vector<float> &v = keyframes.values;
+  size_t last = t.size() - 1;
+
+  if (time <= t[0])
+    return v[0];
+  if (time >= t[last])
+    return v[last];
+
+  // The segment [k; k + 1] holding the time.
+  size_t k = static_cast<size_t>(std::upper_bound(t.begin(), t.end(), time) - t.begin()) - 1;
+  double span = t[k + 1] - t[k];
+  double s = (time - t[k]) / span;
+
+  if (!cubic)
+    return static_cast<float>(v[k] + (v[k + 1] - v[k]) * s);
+
+  // Tangents from the neighbouring keyframes, in value per segment.
+  double m0 = (k == 0) ? 0.0 : (v[k + 1] - v[k - 1]) / (t[k + 1] - t[k - 1]) * span;
+  double m1 = (k + 1 == last) ? 0.0 : (v[k + 2] - v[k]) / (t[k + 2] - t[k]) * span;
+
+  double s2 = s * s;
+  double s3 = s2 * s;
+  return static_cast<float>((2 * s3 - 3 * s2 + 1) * v[k] + (s3 - 2 * s2 + s) * m0
+                            + (-2 * s3 + 3 * s2) * v[k + 1] + (s3 - s2) * m1);
+}
+
+} // namespace smov
@@ -0,0 +1,90 @@
+#include <cmath>
+
+#include <gtest/gtest.h>
+
+#include <states/source_watchdog.h>
+
+namespace {
+
+const int64_t MS = 1000000;
+
+}
+
+TEST(SourceWatchdog, SourceIsLateOncePastItsDeadline) {
+  smov::SourceWatchdog watchdog;
+  watchdog.configure(100 * MS);
+  watchdog.register_source(1, 0);
+
+  // A source that never sent values is not late.
+  EXPECT_FALSE(watchdog.is_late(1, 500 * MS));
+  EXPECT_EQ(watchdog.get_age(1, 500 * MS), -1);
+
+  watchdog.record(1, smov::STREAM_FRONT, 1000 * MS);
+  EXPECT_FALSE(watchdog.is_late(1, 1100 * MS));
+  EXPECT_TRUE(watchdog.is_late(1, 1101 * MS));
+  EXPECT_EQ(watchdog.get_age(1, 1101 * MS), 101 * MS);
+
+  watchdog.keep_alive(1, 1150 * MS);
+  EXPECT_FALSE(watchdog.is_late(1, 1200 * MS));
+}
+
+TEST(SourceWatchdog, OwnDeadlineOverridesTheDefaultOne) {
+  smov::SourceWatchdog watchdog;
+  watchdog.configure(100 * MS);
+  watchdog.register_source(1, 20 * MS);
+  watchdog.register_source(2, 0);
+
+  EXPECT_EQ(watchdog.get_deadline(1), 20 * MS);
+  EXPECT_EQ(watchdog.get_deadline(2), 100 * MS);
+
+  watchdog.record(1, smov::STREAM_BODY, 1000 * MS);
+  EXPECT_TRUE(watchdog.is_late(1, 1021 * MS));
+}
+
+TEST(SourceWatchdog, DisabledWithoutDeadline) {
+  smov::SourceWatchdog watchdog;
+  watchdog.register_source(1, 0);
+
+  watchdog.record(1, smov::STREAM_FRONT, 1000 * MS);
+  EXPECT_FALSE(watchdog.is_late(1, 100000 * MS));
+}
+
+TEST(SourceWatchdog, KeepsTheMeanAndVarianceOfTheIntervals) {
+  smov::SourceWatchdog watchdog;
+  watchdog.register_source(1, 0);
+
+  // Intervals of 10, 20 and 30 ms.
+  watchdog.record(1, smov::STREAM_BACK, 1000 * MS);
+  watchdog.record(1, smov::STREAM_BACK, 1010 * MS);
+  watchdog.record(1, smov::STREAM_BACK, 1030 * MS);
+  watchdog.record(1, smov::STREAM_BACK, 1060 * MS);
+
+  const smov::StreamStats &stats = watchdog.get_stats(1, smov::STREAM_BACK);
+  EXPECT_EQ(stats.count, 4u);
+  EXPECT_DOUBLE_EQ(stats.mean, 20.0 * MS);
+  EXPECT_NEAR(std::sqrt(stats.m2 / static_cast<double>(stats.count - 2)), 10.0 * MS, 1.0);
+  EXPECT_EQ(stats.max, 30 * MS);
+  EXPECT_EQ(watchdog.get_stats(1, smov::STREAM_FRONT).count, 0u);
+}
+
+TEST(SourceWatchdog, ForgottenSourceStartsOver) {
+  smov::SourceWatchdog watchdog;
+  watchdog.configure(100 * MS);
+  watchdog.register_source(1, 0);
+
+  watchdog.record(1, smov::STREAM_FRONT, 1000 * MS);
+  watchdog.record(1, smov::STREAM_FRONT, 1010 * MS);
+  watchdog.count_miss(1);
+  watchdog.forget(1);
+
+  EXPECT_FALSE(watchdog.is_late(1, 5000 * MS));
+  EXPECT_EQ(watchdog.get_age(1, 5000 * MS), -1);
+  EXPECT_EQ(watchdog.get_stats(1, smov::STREAM_FRONT).count, 0u);
+  EXPECT_EQ(watchdog.get_misses(1), 1u);
+
+  // The time it was away is not an interval.
+  watchdog.record(1, smov::STREAM_FRONT, 9000 * MS);
+  watchdog.record(1, smov::STREAM_FRONT, 9010 * MS);
+  EXPECT_DOUBLE_EQ(watchdog.get_stats(1, smov::STREAM_FRONT).mean, 10.0 * MS);
+  EXPECT_EQ(watchdog.get_stats(1, smov::STREAM_FRONT).max, 10 * MS);
+}
@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+
+#include <states/state_arbiter.h>
+
+namespace {
+
+// Steady clock nanoseconds, 0 meaning a state never sent values.
+const int64_t MS = 1000000;
+
+}
+
+TEST(StateArbiter, FirstStateTakesTheFreeServos) {
+  smov::StateArbiter arbiter;
+  arbiter.register_state(1, 0);
+
+  EXPECT_EQ(arbiter.decide(1, 10 * MS), smov::ARBITER_TAKEOVER);
+  EXPECT_EQ(arbiter.get_owner(), 1);
+  EXPECT_EQ(arbiter.decide(1, 20 * MS), smov::ARBITER_ACCEPT);
+}
+
+TEST(StateArbiter, UnknownStatesAreRejected) {
+  smov::StateArbiter arbiter;
+  arbiter.register_state(1, 0);
+
+  EXPECT_EQ(arbiter.decide(0, 10 * MS), smov::ARBITER_REJECT);
+  EXPECT_EQ(arbiter.decide(2, 10 * MS), smov::ARBITER_REJECT);
+  EXPECT_EQ(arbiter.get_owner(), 0);
+}
+
+TEST(StateArbiter, HigherPriorityPreemptsTheOwner) {
+  smov::StateArbiter arbiter;
+  arbiter.register_state(1, 0);
+  arbiter.register_state(2, 5);
+
+  EXPECT_EQ(arbiter.decide(1, 10 * MS), smov::ARBITER_TAKEOVER);
+  EXPECT_EQ(arbiter.decide(2, 20 * MS), smov::ARBITER_TAKEOVER);
+  EXPECT_EQ(arbiter.get_owner(), 2);
+
+  // Without a lease, the owner stays live until it ends.
+  EXPECT_EQ(arbiter.decide(1, 30 * MS), smov::ARBITER_REJECT);
+  EXPECT_EQ(arbiter.get_owner(), 2);
+}
+
+TEST(StateArbiter, EqualPriorityDoesNotPreempt) {
+  smov::StateArbiter arbiter;
+  arbiter.register_state(1, 3);
+  arbiter.register_state(2, 3);
+
+  EXPECT_EQ(arbiter.decide(1, 10 * MS), smov::ARBITER_TAKEOVER);
+  EXPECT_EQ(arbiter.decide(2, 20 * MS), smov::ARBITER_REJECT);
+  EXPECT_EQ(arbiter.get_owner(), 1);
+}
+
+TEST(StateArbiter, FreeServosWaitForTheLiveStateWithTheHighestPriority) {
+  smov::StateArbiter arbiter;
+  arbiter.register_state(1, 0);
+  arbiter.register_state(2, 5);
+
+  EXPECT_EQ(arbiter.decide(2, 10 * MS), smov::ARBITER_TAKEOVER);
+  EXPECT_TRUE(arbiter.release(2));
+  EXPECT_EQ(arbiter.decide(1, 20 * MS), smov::ARBITER_TAKEOVER);
+
+  // A state that is heard of again takes the servos back.
+  EXPECT_EQ(arbiter.decide(2, 30 * MS), smov::ARBITER_TAKEOVER);
+  EXPECT_FALSE(arbiter.release(1));
+}
+
+TEST(StateArbiter, LeaseExpiresWhenTheOwnerGoesQuiet) {
+  smov::StateArbiter arbiter;
+  arbiter.configure(100 * MS, 0);
+  arbiter.register_state(1, 5);
+  arbiter.register_state(2, 0);
+
+  EXPECT_EQ(arbiter.decide(1, 10 * MS), smov::ARBITER_TAKEOVER);
+  EXPECT_EQ(arbiter.expire(110 * MS), 0);
+  EXPECT_EQ(arbiter.decide(2, 110 * MS), smov::ARBITER_REJECT);
+
+  EXPECT_EQ(arbiter.expire(111 * MS), 1);
+  EXPECT_EQ(arbiter.get_owner(), 0);
+  EXPECT_EQ(arbiter.expire(112 * MS), 0);
+
+  // A lower priority state can take the servos of a state past its lease.
+  EXPECT_EQ(arbiter.decide(2, 120 * MS), smov::ARBITER_TAKEOVER);
+}
+
+TEST(StateArbiter, LowerPriorityTakesOverAnOwnerPastItsLease) {
+  smov::StateArbiter arbiter;
+  arbiter.configure(100 * MS, 0);
+  arbiter.register_state(1, 5);
+  arbiter.register_state(2, 0);
+
+  EXPECT_EQ(arbiter.decide(1, 10 * MS), smov::ARBITER_TAKEOVER);
+  EXPECT_EQ(arbiter.decide(2, 200 * MS), smov::ARBITER_TAKEOVER);
+  EXPECT_EQ(arbiter.get_owner(), 2);
+}
+
+TEST(StateArbiter, HandoverBlendsFromThePreviousOutput) {
+  smov::StateArbiter arbiter;
+  arbiter.configure(0, 100 * MS);
+  arbiter.register_state(1, 0);
+  arbiter.set_output(0, 10.0f);
+
+  EXPECT_EQ(arbiter.decide(1, 1000 * MS), smov::ARBITER_TAKEOVER);
+  arbiter.set_target(0, 30.0f);
+
+  EXPECT_TRUE(arbiter.advance_blend(1000 * MS));
+  EXPECT_FLOAT_EQ(arbiter.get_output(0, 1000 * MS), 10.0f);
+  EXPECT_FLOAT_EQ(arbiter.get_output(0, 1050 * MS), 20.0f);
+  EXPECT_TRUE(arbiter.advance_blend(1100 * MS));
+  EXPECT_FLOAT_EQ(arbiter.get_output(0, 1100 * MS), 30.0f);
+  EXPECT_FALSE(arbiter.advance_blend(1110 * MS));
+
+  // The servos the new owner does not drive hold where they were.
+  EXPECT_FLOAT_EQ(arbiter.get_output(1, 1110 * MS), 0.0f);
+}
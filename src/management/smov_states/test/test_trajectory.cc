@@ -0,0 +1,119 @@
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <states/trajectory.h>
+
+namespace {
+
+// Keyframes setting every servo to the same value.
+std::vector<float> uniform_values(const std::vector<float> &keyframes) {
+  std::vector<float> values;
+  for (float value : keyframes)
+    values.insert(values.end(), ARBITER_SERVOS, value);
+  return values;
+}
+
+float sample_servo(const smov::Trajectory &trajectory, double time, int servo) {
+  float output[ARBITER_SERVOS]{};
+  trajectory.sample(time, output);
+  return output[servo];
+}
+
+}
+
+TEST(Trajectory, LinearStartsFromTheCurrentValue) {
+  float start[ARBITER_SERVOS]{};
+  start[0] = 10.0f;
+  smov::Trajectory trajectory;
+  std::string error;
+  ASSERT_TRUE(trajectory.load(false, {100, 300}, {}, uniform_values({20.0f, 40.0f}), start, error));
+
+  EXPECT_DOUBLE_EQ(trajectory.get_duration(), 300.0);
+  EXPECT_FLOAT_EQ(sample_servo(trajectory, 0.0, 0), 10.0f);
+  EXPECT_FLOAT_EQ(sample_servo(trajectory, 50.0, 0), 15.0f);
+  EXPECT_FLOAT_EQ(sample_servo(trajectory, 100.0, 0), 20.0f);
+  EXPECT_FLOAT_EQ(sample_servo(trajectory, 200.0, 0), 30.0f);
+  EXPECT_FLOAT_EQ(sample_servo(trajectory, 300.0, 0), 40.0f);
+  EXPECT_FLOAT_EQ(sample_servo(trajectory, 400.0, 0), 40.0f);
+  EXPECT_FLOAT_EQ(sample_servo(trajectory, 50.0, 1), 10.0f);
+
+  EXPECT_FALSE(trajectory.is_done(299.0));
+  EXPECT_TRUE(trajectory.is_done(300.0));
+}
+
+TEST(Trajectory, KeyframeAtTheStartReplacesTheCurrentValue) {
+  float start[ARBITER_SERVOS]{};
+  start[0] = 10.0f;
+  smov::Trajectory trajectory;
+  std::string error;
+  ASSERT_TRUE(trajectory.load(false, {0, 100}, {}, uniform_values({50.0f, 60.0f}), start, error));
+
+  EXPECT_FLOAT_EQ(sample_servo(trajectory, 0.0, 0), 50.0f);
+  EXPECT_FLOAT_EQ(sample_servo(trajectory, -10.0, 0), 50.0f);
+}
+
+TEST(Trajectory, CubicHitsTheKeyframesAtRestOnTheEnds) {
+  float start[ARBITER_SERVOS]{};
+  smov::Trajectory trajectory;
+  std::string error;
+  ASSERT_TRUE(trajectory.load(true, {0, 100, 200}, {}, uniform_values({0.0f, 10.0f, 0.0f}), start, error));
+
+  EXPECT_FLOAT_EQ(sample_servo(trajectory, 0.0, 0), 0.0f);
+  EXPECT_FLOAT_EQ(sample_servo(trajectory, 100.0, 0), 10.0f);
+  EXPECT_FLOAT_EQ(sample_servo(trajectory, 200.0, 0), 0.0f);
+  EXPECT_FLOAT_EQ(sample_servo(trajectory, 250.0, 0), 0.0f);
+
+  // Zero tangents on the first and last keyframes, and on the peak between two equal neighbours.
+  EXPECT_NEAR(sample_servo(trajectory, 1.0, 0), 0.0f, 0.01f);
+  EXPECT_NEAR(sample_servo(trajectory, 199.0, 0), 0.0f, 0.01f);
+  EXPECT_NEAR(sample_servo(trajectory, 99.0, 0), 10.0f, 0.01f);
+  EXPECT_FLOAT_EQ(sample_servo(trajectory, 50.0, 0), 5.0f);
+}
+
+TEST(Trajectory, CubicFollowsALinearRamp) {
+  float start[ARBITER_SERVOS]{};
+  smov::Trajectory trajectory;
+  std::string error;
+  ASSERT_TRUE(trajectory.load(true, {0, 100, 200, 300}, {}, uniform_values({0.0f, 10.0f, 20.0f, 30.0f}), start,
+                              error));
+
+  // Inner keyframes take the slope of their neighbours, so the middle segment stays on the ramp.
+  EXPECT_FLOAT_EQ(sample_servo(trajectory, 150.0, 0), 15.0f);
+}
+
+TEST(Trajectory, MaskedServosAreLeftAsTheyAre) {
+  float start[ARBITER_SERVOS]{};
+  smov::Trajectory trajectory;
+  std::string error;
+  ASSERT_TRUE(trajectory.load(false, {100}, {0x0001}, uniform_values({20.0f}), start, error));
+
+  float output[ARBITER_SERVOS];
+  for (float &value : output)
+    value = -1.0f;
+  trajectory.sample(100.0, output);
+  EXPECT_FLOAT_EQ(output[0], 20.0f);
+  for (int servo = 1; servo < ARBITER_SERVOS; servo++)
+    EXPECT_FLOAT_EQ(output[servo], -1.0f);
+}
+
+TEST(Trajectory, InconsistentKeyframesAreRejected) {
+  float start[ARBITER_SERVOS]{};
+  smov::Trajectory trajectory;
+  std::string error;
+
+  EXPECT_FALSE(trajectory.load(false, {}, {}, {}, start, error));
+  EXPECT_EQ(error, "no keyframes");
+  EXPECT_FALSE(trajectory.load(false, {100}, {}, {1.0f}, start, error));
+  EXPECT_FALSE(trajectory.load(false, {100, 200}, {0x0001}, uniform_values({1.0f, 2.0f}), start, error));
+  EXPECT_FALSE(trajectory.load(false, {100, 100}, {}, uniform_values({1.0f, 2.0f}), start, error));
+  EXPECT_EQ(error, "keyframe times must be increasing");
+
+  // A rejected load leaves the trajectory empty.
+  EXPECT_DOUBLE_EQ(trajectory.get_duration(), 0.0);
+  float output[ARBITER_SERVOS]{};
+  output[0] = 7.0f;
+  trajectory.sample(50.0, output);
+  EXPECT_FLOAT_EQ(output[0], 7.0f);
+}